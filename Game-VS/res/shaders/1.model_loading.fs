@@ -4,8 +4,14 @@ out vec4 FragColor;
 in vec2 TexCoords;
 
 uniform sampler2D texture_diffuse1;
+// texture_diffuse1 once packed into a texture array, and its layer there (negative if it isn't packed)
+uniform sampler2DArray texture_diffuse1_array;
+uniform float texture_diffuse1_layer;
 
 void main()
 {     
-    FragColor = texture(texture_diffuse1, TexCoords);
+    if (texture_diffuse1_layer >= 0.0)
+        FragColor = texture(texture_diffuse1_array, vec3(TexCoords, texture_diffuse1_layer));
+    else
+        FragColor = texture(texture_diffuse1, TexCoords);
 }
\ No newline at end of file
@@ -5,11 +5,18 @@ layout (location = 2) in vec2 aTexCoords;
 
 out vec2 TexCoords;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// shared by every program, see UniformBuffers
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec4 cameraPosition;
+};
+layout (std140) uniform Transforms {
+    mat4 models[256];
+};
+uniform int transformIndex;
 
 void main() {
     TexCoords = aTexCoords;    
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = projection * view * models[transformIndex] * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,15 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D impostorAtlas;
+
+void main()
+{
+    vec4 color = texture(impostorAtlas, TexCoords);
+    // the atlas is transparent wherever the model wasn't drawn
+    if (color.a < 0.5)
+        discard;
+    FragColor = vec4(color.rgb, 1.0);
+}
@@ -0,0 +1,32 @@
+#version 330 core
+layout (location = 0) in vec2 aCorner;     // corner of the quad, in [-1, 1]
+layout (location = 1) in vec4 aCenterRadius; // world space bounding sphere of the object
+layout (location = 2) in vec2 aYawRow;     // rotation of the object around the y axis, and atlas row of its model
+
+out vec2 TexCoords;
+
+// shared by every program, see UniformBuffers
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec4 cameraPosition;
+};
+uniform int numViews;
+uniform int numRows;
+
+const float PI = 3.14159265;
+
+void main() {
+    // face the camera, rotating around the vertical axis only, like the views were baked
+    vec3 toCamera = cameraPosition.xyz - aCenterRadius.xyz;
+    toCamera.y = 0.0;
+    toCamera = length(toCamera) > 0.0001 ? normalize(toCamera) : vec3(0.0, 0.0, 1.0);
+    vec3 right = vec3(toCamera.z, 0.0, -toCamera.x);
+    vec3 position = aCenterRadius.xyz + (right * aCorner.x + vec3(0.0, 1.0, 0.0) * aCorner.y) * aCenterRadius.w;
+
+    // use the baked view closest to the direction the camera sees the object from, in the object's own frame
+    float azimuth = atan(toCamera.x, toCamera.z) - aYawRow.x;
+    float cell = mod(floor(azimuth / (2.0 * PI) * float(numViews) + 0.5), float(numViews));
+    TexCoords = vec2((cell + aCorner.x * 0.5 + 0.5) / float(numViews), (aYawRow.y + aCorner.y * 0.5 + 0.5) / float(numRows));
+    gl_Position = projection * view * vec4(position, 1.0);
+}
@@ -5,8 +5,12 @@ layout (location = 3) in mat4 instanceMatrix;
 
 out vec2 TexCoords;
 
-uniform mat4 view;
-uniform mat4 projection;
+// shared by every program, see UniformBuffers
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec4 cameraPosition;
+};
 
 void main() {
     TexCoords = aTexCoords;    
@@ -6,7 +6,12 @@ layout (location = 2) in vec2 aTexCoords;
 out vec2 TexCoords;
 out vec4 ParticleColor;
 
-uniform mat4 projection;
+// shared by every program, see UniformBuffers
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec4 cameraPosition;
+};
 uniform vec3 offset;
 uniform vec4 color;
 
@@ -4,6 +4,7 @@
 #include "AudioEngine.h"
 #include <FMOD/fmod_errors.h>
 #include <iostream>
+#include "../Game-Engine/Trace.h"
 
 AudioEngine::AudioEngine() : sounds(), loopsPlaying(), soundBanks(), 
     eventDescriptions(), eventInstances() {}
@@ -31,6 +32,7 @@ void AudioEngine::loadSound(SoundInfo soundInfo) {
     if (!soundInfo.isLoaded()) {
         std::cout << "Audio Engine: Loading Sound from file " << soundInfo.getFilePath() << '\n';
         FMOD::Sound* sound;
+        TRACE_SCOPE("audio", "createSound", soundInfo.getFilePath());
         ERRCHECK(lowLevelSystem->createSound(soundInfo.getFilePath(), soundInfo.is3D() ? FMOD_3D : FMOD_2D, 0, &sound));
         ERRCHECK(sound->setMode(soundInfo.isLoop() ? FMOD_LOOP_NORMAL : FMOD_LOOP_OFF));
         ERRCHECK(sound->set3DMinMaxDistance(0.5f * DISTANCEFACTOR, 5000.0f * DISTANCEFACTOR));
@@ -137,6 +139,7 @@ unsigned int AudioEngine::getSoundLengthInMS(SoundInfo soundInfo) {
 void AudioEngine::loadFMODStudioBank(const char* filepath) {
     std::cout << "Audio Engine: Loading FMOD Studio Sound Bank " << filepath << '\n';
     FMOD::Studio::Bank* bank = NULL;
+    TRACE_SCOPE("audio", "loadBankFile", filepath);
     ERRCHECK(studioSystem->loadBankFile(filepath, FMOD_STUDIO_LOAD_BANK_NORMAL, &bank));
     soundBanks.insert({ filepath, bank });
 }
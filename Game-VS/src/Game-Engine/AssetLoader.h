@@ -0,0 +1,138 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include "Model.h"
+#include "WorkerPool.h"
+
+/**
+ * Asynchronous model loader. Model files are parsed (or read from the mesh cache) and their new textures decoded on a pool
+ * of worker threads; the CPU-ready results are queued for the GL thread, which uploads them with processUploads()
+ * under a per-frame time budget. Models returned by load() start out empty and get their meshes as they are uploaded.
+ */
+class AssetLoader {
+public:
+    /**
+     * Constructs the loader and starts its worker threads.
+     */
+    explicit AssetLoader(unsigned int numThreads = WorkerPool::defaultThreadCount()) : pool(numThreads) {
+        std::cout << "Asset Loader: using " << pool.getThreadCount() << " worker threads\n";
+    }
+
+    /**
+     * Starts loading a model file in the background and returns the (still empty) model right away.
+     */
+    std::shared_ptr<Model> load(const std::string& path, const ModelLoadOptions& options = ModelLoadOptions()) {
+        std::cout << "Loading Model " << path << " (async)\n";
+        std::shared_ptr<LoadRequest> request = std::make_shared<LoadRequest>();
+        request->model = std::make_shared<Model>();
+        Model::applyOptions(options, request->data);
+        pending++;
+        pool.submit([this, request, path]() { importModel(request, path); });
+        return request->model;
+    }
+
+    /**
+     * Uploads models finished by the worker threads. Must be called on the GL thread, usually once per frame.
+     * Uploading stops once the time budget is used up; a partially uploaded model continues on the next call.
+     * @return the number of models that finished uploading during this call
+     */
+    unsigned int processUploads(double budgetMS) {
+        auto start = std::chrono::steady_clock::now();
+        auto overBudget = [&]() {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() >= budgetMS;
+        };
+        unsigned int completed = 0;
+        while (true) {
+            if (!uploading) {
+                std::lock_guard<std::mutex> lock(readyMutex);
+                if (ready.empty())
+                    break;
+                uploading = ready.front();
+                ready.pop_front();
+            }
+            LoadRequest& request = *uploading;
+            while (request.nextMesh < request.data.meshes.size()) {
+                request.model->uploadMesh(request.data, request.nextMesh++);
+                if (overBudget())
+                    return completed;
+            }
+            // everything is on the GPU, the CPU copies can go
+            uploading.reset();
+            pending--;
+            completed++;
+            if (overBudget())
+                break;
+        }
+        return completed;
+    }
+
+    /**
+     * Gets the worker threads used for loading, e.g. to share them with a TextureStreamer.
+     */
+    WorkerPool& getWorkerPool() {
+        return pool;
+    }
+
+    /**
+     * Checks if every requested model has been fully uploaded.
+     */
+    bool isIdle() const {
+        return pending == 0;
+    }
+
+    /**
+     * Gets the number of models that are still being loaded or uploaded.
+     */
+    unsigned int getPendingCount() const {
+        return pending;
+    }
+
+private:
+    struct LoadRequest {
+        std::shared_ptr<Model> model;
+        ModelData data;
+        std::atomic<unsigned int> remainingTextures{ 0 };
+        size_t nextMesh = 0;
+    };
+
+    std::mutex readyMutex;
+    std::deque<std::shared_ptr<LoadRequest>> ready;   // imported and decoded, waiting for the GL thread
+    std::shared_ptr<LoadRequest> uploading;           // partially uploaded model, only touched by the GL thread
+    std::atomic<unsigned int> pending{ 0 };
+    // declared last so the worker threads are joined before the queues they use are destroyed
+    WorkerPool pool;
+
+    /**
+     * Worker job: imports the model file, then fans out one job per texture to get it decoded by the texture cache.
+     * When textures are streamed, they are only requested and the model is ready for upload right away.
+     */
+    void importModel(std::shared_ptr<LoadRequest> request, const std::string& path) {
+        Model::importModelData(path, request->data);
+        if (request->data.textures.empty() || TextureCache::instance().isStreaming()) {
+            Model::prepareTextures(request->data);
+            markReady(request);
+            return;
+        }
+        request->remainingTextures = (unsigned int)request->data.textures.size();
+        // the map was fully built by the import, so each job can safely fill in its own entry
+        for (auto& pair : request->data.textures) {
+            TextureHandle* handle = &pair.second;
+            const std::string* texturePath = &pair.first;
+            pool.submit([this, request, handle, texturePath]() {
+                *handle = TextureCache::instance().prepare(request->data.directory, *texturePath);
+                if (--request->remainingTextures == 0)
+                    markReady(request);
+            });
+        }
+    }
+
+    void markReady(std::shared_ptr<LoadRequest> request) {
+        std::lock_guard<std::mutex> lock(readyMutex);
+        ready.push_back(request);
+    }
+};
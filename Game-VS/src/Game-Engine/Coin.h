@@ -12,9 +12,10 @@ class Coin : public GameObject, public Animation, public SphereCollider {
 public:
 	/**
 	 * Constructs the coin with provided file location, translation, scale and rotation values.
+	 * @param radius radius of the sphere within which the player picks the coin up
 	 */
-	Coin(const char* objFile, glm::vec3 defTrans, glm::vec3 defScale, glm::vec3 defRot) 
-		: GameObject(objFile, defTrans, defScale, defRot), SphereCollider(defTrans, 3.0f) {
+	Coin(const char* objFile, glm::vec3 defTrans, glm::vec3 defScale, glm::vec3 defRot, float radius = 3.0f) 
+		: GameObject(objFile, defTrans, defScale, defRot), SphereCollider(defTrans, radius) {
 	}
 		
 	/**
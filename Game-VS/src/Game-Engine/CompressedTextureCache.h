@@ -0,0 +1,209 @@
+#pragma once
+#include <glad.h>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "TextureCooker.h"
+#include "FileCache.h"
+#include "MappedFile.h"
+#include "Trace.h"
+
+/**
+ * A mip level inside a mapped compressed texture file.
+ */
+struct CompressedLevel {
+    int width = 0, height = 0;
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+};
+
+/**
+ * On-disk cache of block compressed textures cooked by TextureCooker, in a small KTX-like container.
+ * A file is keyed by the normalized path of the source image and validated against its modification time and size.
+ * It is stored under res/cache/textures/ and mapped on load, so the mip levels can be handed to
+ * glCompressedTexImage2D without decoding anything.
+ *
+ * File layout (all offsets from the start of the file, little endian):
+ *   CompressedTextureHeader | CompressedLevelEntry[levelCount] | level data (each level aligned to 16)
+ */
+class CompressedTextureCache {
+public:
+    // bump whenever the layout of the file or the cooking changes so that stale caches are rebuilt
+    static const uint32_t VERSION = 1;
+
+    /**
+     * Maps the cache file of a source image. Returns false on a cache miss (no file, stale file, or corrupt file).
+     */
+    bool open(const std::string& sourcePath) {
+        TRACE_SCOPE("io", "CompressedTextureCache::open", sourcePath);
+        close();
+        std::string key = FileCache::normalizePath(sourcePath);
+        SourceFileStamp source = FileCache::stamp(key);
+        if (!source.exists || !file.open(cachePath(key)))
+            return false;
+        if (!parse(source)) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Unmaps the cache file.
+     */
+    void close() {
+        file.close();
+        levels.clear();
+        internalFormat = 0;
+        contentHash = 0;
+    }
+
+    bool isOpen() const {
+        return file.isOpen();
+    }
+
+    GLenum getInternalFormat() const {
+        return internalFormat;
+    }
+
+    /**
+     * Gets the hash of the source file's bytes, as passed to write().
+     */
+    uint64_t getContentHash() const {
+        return contentHash;
+    }
+
+    const std::vector<CompressedLevel>& getLevels() const {
+        return levels;
+    }
+
+    /**
+     * Gets the total size of all mip levels, which is also the GPU memory used by the texture.
+     */
+    size_t getByteSize() const {
+        size_t bytes = 0;
+        for (const CompressedLevel& level : levels)
+            bytes += level.size;
+        return bytes;
+    }
+
+    /**
+     * Writes (or replaces) the cache file of a source image. Returns false on failure.
+     * @param contentHash hash of the source file's bytes, used by the TextureCache to find identical files
+     */
+    static bool write(const std::string& sourcePath, uint64_t contentHash, const CookedTexture& texture) {
+        TRACE_SCOPE("io", "CompressedTextureCache::write", sourcePath);
+        std::string key = FileCache::normalizePath(sourcePath);
+        SourceFileStamp source = FileCache::stamp(key);
+        if (!source.exists || texture.levels.empty())
+            return false;
+
+        std::vector<CompressedLevelEntry> entries(texture.levels.size());
+        size_t offset = FileCache::align(sizeof(CompressedTextureHeader) + entries.size() * sizeof(CompressedLevelEntry), 16);
+        for (size_t i = 0; i < entries.size(); i++) {
+            entries[i].width = (uint32_t)texture.levels[i].width;
+            entries[i].height = (uint32_t)texture.levels[i].height;
+            entries[i].offset = offset;
+            entries[i].size = texture.levels[i].blocks.size();
+            offset = FileCache::align(offset + texture.levels[i].blocks.size(), 16);
+        }
+
+        std::vector<char> data(offset, 0);
+        CompressedTextureHeader header;
+        std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+        header.version = VERSION;
+        header.sourceModifiedTime = source.modifiedTime;
+        header.sourceSize = source.size;
+        header.contentHash = contentHash;
+        header.internalFormat = texture.internalFormat;
+        header.levelCount = (uint32_t)entries.size();
+        std::memcpy(&data[0], &header, sizeof(header));
+        std::memcpy(&data[sizeof(header)], entries.data(), entries.size() * sizeof(CompressedLevelEntry));
+        for (size_t i = 0; i < entries.size(); i++)
+            std::memcpy(&data[(size_t)entries[i].offset], texture.levels[i].blocks.data(), texture.levels[i].blocks.size());
+        return FileCache::writeFile(cachePath(key), data);
+    }
+
+private:
+    static constexpr const char* MAGIC = "FSTX";
+
+    struct CompressedTextureHeader {
+        char     magic[4];
+        uint32_t version;
+        uint64_t sourceModifiedTime;
+        uint64_t sourceSize;
+        uint64_t contentHash;
+        uint32_t internalFormat;
+        uint32_t levelCount;
+    };
+
+    struct CompressedLevelEntry {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint64_t offset = 0;
+        uint64_t size = 0;
+    };
+
+    MappedFile file;
+    std::vector<CompressedLevel> levels;
+    GLenum internalFormat = 0;
+    uint64_t contentHash = 0;
+
+    static std::string cachePath(const std::string& key) {
+        return FileCache::cacheFilePath("textures", FileCache::hash(key), ".tcache");
+    }
+
+    /**
+     * Validates the mapped file against the source image and builds the level views, bounds checking every offset.
+     */
+    bool parse(const SourceFileStamp& source) {
+        const unsigned char* base = file.data();
+        size_t size = file.size();
+        if (size < sizeof(CompressedTextureHeader))
+            return false;
+        CompressedTextureHeader header;
+        std::memcpy(&header, base, sizeof(header));
+        if (std::memcmp(header.magic, MAGIC, sizeof(header.magic)) != 0 || header.version != VERSION ||
+            header.sourceModifiedTime != source.modifiedTime || header.sourceSize != source.size || header.levelCount == 0)
+            return false;
+        if (sizeof(header) + (size_t)header.levelCount * sizeof(CompressedLevelEntry) > size)
+            return false;
+        unsigned int blockSize = TextureCooker::blockSize(header.internalFormat);
+        for (uint32_t i = 0; i < header.levelCount; i++) {
+            CompressedLevelEntry entry;
+            std::memcpy(&entry, base + sizeof(header) + i * sizeof(CompressedLevelEntry), sizeof(entry));
+            size_t expected = (size_t)((entry.width + 3) / 4) * ((entry.height + 3) / 4) * blockSize;
+            if (entry.size != expected || entry.offset + entry.size > size)
+                return false;
+            CompressedLevel level;
+            level.width = (int)entry.width;
+            level.height = (int)entry.height;
+            level.data = base + entry.offset;
+            level.size = (size_t)entry.size;
+            levels.push_back(level);
+        }
+        internalFormat = header.internalFormat;
+        contentHash = header.contentHash;
+        return true;
+    }
+};
+
+/**
+ * Creates an OpenGL texture from a mapped compressed texture, uploading every mip level. Must be called on the GL thread.
+ */
+inline unsigned int TextureFromCompressed(const CompressedTextureCache& compressed, size_t* uploadedBytes = nullptr) {
+    TRACE_SCOPE("upload", "TextureFromCompressed");
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    const std::vector<CompressedLevel>& levels = compressed.getLevels();
+    for (size_t i = 0; i < levels.size(); i++)
+        glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, compressed.getInternalFormat(), levels[i].width, levels[i].height, 0,
+                               (GLsizei)levels[i].size, levels[i].data);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+    SetTextureParameters();
+    if (uploadedBytes)
+        *uploadedBytes = compressed.getByteSize();
+    return textureID;
+}
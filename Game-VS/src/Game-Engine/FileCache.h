@@ -0,0 +1,127 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <system_error>
+#include <cctype>
+
+/**
+ * Modification time and size of a source asset, used to decide if a cooked cache file is still up to date.
+ */
+struct SourceFileStamp {
+    bool exists = false;
+    uint64_t modifiedTime = 0;
+    uint64_t size = 0;
+};
+
+/**
+ * Helper functions shared by the on-disk asset caches (cooked meshes, textures, etc).
+ * Cache files are named after a hash of their key and live under res/cache/.
+ */
+class FileCache {
+public:
+    // root directory of all cooked files, relative to the working directory like the rest of res/
+    static constexpr const char* ROOT_DIRECTORY = "res/cache";
+
+    /**
+     * 64 bit FNV-1a hash of a block of bytes. Can be chained by passing the previous result as the seed.
+     */
+    static uint64_t hash(const void* data, size_t size, uint64_t seed = 14695981039346656037ull) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        uint64_t h = seed;
+        for (size_t i = 0; i < size; i++) {
+            h ^= bytes[i];
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    static uint64_t hash(const std::string& str, uint64_t seed = 14695981039346656037ull) {
+        return hash(str.data(), str.size(), seed);
+    }
+
+    /**
+     * Gets the absolute, normalized form of a path, so that different spellings of the same file share one key.
+     */
+    static std::string normalizePath(const std::filesystem::path& path) {
+        std::error_code error;
+        std::filesystem::path absolute = std::filesystem::absolute(path, error);
+        std::string normalized = (error ? path : absolute).lexically_normal().generic_string();
+#ifdef _WIN32
+        // file names are case insensitive on Windows, and asset files don't always agree on the case
+        for (char& c : normalized)
+            c = (char)std::tolower((unsigned char)c);
+#endif
+        return normalized;
+    }
+
+    /**
+     * Gets the modification time and size of a file on disk.
+     */
+    static SourceFileStamp stamp(const std::string& path) {
+        SourceFileStamp result;
+        std::error_code error;
+        auto time = std::filesystem::last_write_time(path, error);
+        if (error)
+            return result;
+        auto size = std::filesystem::file_size(path, error);
+        if (error)
+            return result;
+        result.exists = true;
+        result.modifiedTime = (uint64_t)time.time_since_epoch().count();
+        result.size = (uint64_t)size;
+        return result;
+    }
+
+    /**
+     * Builds the path of a cache file inside a sub directory of the cache root, named after the key's hash.
+     */
+    static std::string cacheFilePath(const char* subDirectory, uint64_t key, const char* extension) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+        return std::string(ROOT_DIRECTORY) + '/' + subDirectory + '/' + name + extension;
+    }
+
+    /**
+     * Writes a complete cache file. The data is written to a temporary file first and then renamed,
+     * so a crash mid-write never leaves a truncated cache file behind. Every write gets a temporary file of its own,
+     * so threads writing the same cache file at once don't write into each other's. Returns false on any failure.
+     */
+    static bool writeFile(const std::string& path, const std::vector<char>& data) {
+        std::error_code error;
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+        if (error)
+            return false;
+        static std::atomic<unsigned int> writes(0);
+        char suffix[48];
+        std::snprintf(suffix, sizeof(suffix), ".%zx.%u.tmp", std::hash<std::thread::id>()(std::this_thread::get_id()), writes++);
+        std::string tempPath = path + suffix;
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            if (!out)
+                return false;
+            out.write(data.data(), data.size());
+            if (!out)
+                return false;
+        }
+        std::filesystem::rename(tempPath, path, error);
+        if (error) {
+            std::filesystem::remove(tempPath, error);
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Rounds an offset up to the provided power of two alignment.
+     */
+    static size_t align(size_t offset, size_t alignment) {
+        return (offset + alignment - 1) & ~(alignment - 1);
+    }
+};
@@ -0,0 +1,226 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include "Simd.h"
+
+/**
+ * Result of testing a bounding volume against a frustum.
+ */
+enum FrustumTest {
+    FRUSTUM_OUTSIDE = 0,
+    FRUSTUM_INTERSECTS,
+    FRUSTUM_INSIDE
+};
+
+/**
+ * Transforms an axis-aligned box, returning the axis-aligned box around the result.
+ */
+inline void TransformBoundingBox(const glm::mat4& transform, const glm::vec3& min, const glm::vec3& max,
+                                 glm::vec3& outMin, glm::vec3& outMax) {
+    glm::vec3 center = glm::vec3(transform * glm::vec4((min + max) * 0.5f, 1.0f));
+    glm::vec3 extent = (max - min) * 0.5f;
+    // each axis of the new box spans the absolute projections of the old box's axes on it
+    glm::mat3 axes(transform);
+    glm::vec3 newExtent(0.0f);
+    for (int axis = 0; axis < 3; axis++)
+        newExtent += glm::abs(axes[axis]) * extent[axis];
+    outMin = center - newExtent;
+    outMax = center + newExtent;
+}
+
+/**
+ * The six planes of a camera's view volume, in world space, with their normals pointing inside.
+ */
+class Frustum {
+public:
+    static const unsigned int NUM_PLANES = 6;
+
+    /**
+     * Extracts the planes from the projection and view matrices of a camera.
+     */
+    void update(const glm::mat4& projection, const glm::mat4& view) {
+        glm::mat4 clip = projection * view;
+        glm::vec4 rows[4];
+        for (int row = 0; row < 4; row++)
+            rows[row] = glm::vec4(clip[0][row], clip[1][row], clip[2][row], clip[3][row]);
+        // left, right, bottom, top, near, far
+        planes[0] = rows[3] + rows[0];
+        planes[1] = rows[3] - rows[0];
+        planes[2] = rows[3] + rows[1];
+        planes[3] = rows[3] - rows[1];
+        planes[4] = rows[3] + rows[2];
+        planes[5] = rows[3] - rows[2];
+        for (glm::vec4& plane : planes) {
+            float length = glm::length(glm::vec3(plane));
+            if (length > 0.0f)
+                plane /= length;
+        }
+    }
+
+    /**
+     * Tests an axis-aligned box against the planes.
+     */
+    FrustumTest testBox(const glm::vec3& min, const glm::vec3& max) const {
+        glm::vec3 center = (min + max) * 0.5f;
+        glm::vec3 extent = (max - min) * 0.5f;
+        FrustumTest result = FRUSTUM_INSIDE;
+        for (const glm::vec4& plane : planes) {
+            glm::vec3 normal(plane);
+            float distance = glm::dot(normal, center) + plane.w;
+            float radius = glm::dot(glm::abs(normal), extent);
+            if (distance < -radius)
+                return FRUSTUM_OUTSIDE;
+            if (distance < radius)
+                result = FRUSTUM_INTERSECTS;
+        }
+        return result;
+    }
+
+    /**
+     * Tests a sphere against the planes.
+     */
+    FrustumTest testSphere(const glm::vec3& center, float radius) const {
+        FrustumTest result = FRUSTUM_INSIDE;
+        for (const glm::vec4& plane : planes) {
+            float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+            if (distance < -radius)
+                return FRUSTUM_OUTSIDE;
+            if (distance < radius)
+                result = FRUSTUM_INTERSECTS;
+        }
+        return result;
+    }
+
+    const glm::vec4& getPlane(unsigned int index) const {
+        return planes[index];
+    }
+
+private:
+    glm::vec4 planes[NUM_PLANES];
+};
+
+/**
+ * Objects and meshes culled and kept by a FrustumCuller in the last frame.
+ */
+struct CullStats {
+    unsigned int objectsVisible = 0, objectsCulled = 0;
+    unsigned int meshesVisible = 0, meshesCulled = 0; // meshes of visible objects, tested when the object straddles the frustum
+};
+
+/**
+ * Culls the world space bounding boxes of a frame against a frustum. The boxes are kept as centers and extents in
+ * separate arrays, so each plane is tested against four boxes at once with SSE.
+ */
+class FrustumCuller {
+public:
+    /**
+     * Starts a frame seen by a camera, forgetting the boxes of the last one.
+     */
+    void begin(const glm::mat4& projection, const glm::mat4& view) {
+        frustum.update(projection, view);
+        for (int axis = 0; axis < 3; axis++) {
+            centers[axis].clear();
+            extents[axis].clear();
+        }
+        results.clear();
+        stats = CullStats();
+    }
+
+    /**
+     * Adds a box to cull, returning its index for getResult().
+     */
+    size_t add(const glm::vec3& min, const glm::vec3& max) {
+        glm::vec3 center = (min + max) * 0.5f, extent = (max - min) * 0.5f;
+        for (int axis = 0; axis < 3; axis++) {
+            centers[axis].push_back(center[axis]);
+            extents[axis].push_back(extent[axis]);
+        }
+        return centers[0].size() - 1;
+    }
+
+    /**
+     * Tests every box added since begin() and counts the visible and culled objects.
+     */
+    void cull() {
+        size_t count = centers[0].size();
+        // pad to a whole number of groups of four with empty boxes, whose results are dropped
+        size_t padded = (count + 3) & ~(size_t)3;
+        for (int axis = 0; axis < 3; axis++) {
+            centers[axis].resize(padded, 0.0f);
+            extents[axis].resize(padded, 0.0f);
+        }
+        results.resize(padded);
+        for (size_t first = 0; first < padded; first += 4)
+            testGroup(first);
+        results.resize(count);
+        for (int axis = 0; axis < 3; axis++) {
+            centers[axis].resize(count);
+            extents[axis].resize(count);
+        }
+        for (FrustumTest result : results) {
+            if (result == FRUSTUM_OUTSIDE)
+                stats.objectsCulled++;
+            else
+                stats.objectsVisible++;
+        }
+    }
+
+    /**
+     * Gets the result of the box at an index returned by add(), once cull() has run.
+     */
+    FrustumTest getResult(size_t index) const {
+        return results[index];
+    }
+
+    const Frustum& getFrustum() const {
+        return frustum;
+    }
+
+    /**
+     * Gets the objects and meshes culled and kept in this frame. The mesh counts are kept by whoever draws the objects.
+     */
+    CullStats& getStats() {
+        return stats;
+    }
+
+    void printStats() const {
+        std::cout << "Frustum culling: " << stats.objectsVisible << " objects visible, " << stats.objectsCulled << " culled; "
+                  << stats.meshesVisible << " meshes of straddling objects visible, " << stats.meshesCulled << " culled\n";
+    }
+
+private:
+    Frustum frustum;
+    std::vector<float> centers[3], extents[3]; // x, y and z of the boxes, one array each
+    std::vector<FrustumTest> results;
+    CullStats stats;
+
+    // tests the four boxes starting at first, with the same math as Frustum::testBox
+    void testGroup(size_t first) {
+#if HAS_SSE
+        __m128 cx = _mm_loadu_ps(&centers[0][first]), cy = _mm_loadu_ps(&centers[1][first]), cz = _mm_loadu_ps(&centers[2][first]);
+        __m128 ex = _mm_loadu_ps(&extents[0][first]), ey = _mm_loadu_ps(&extents[1][first]), ez = _mm_loadu_ps(&extents[2][first]);
+        __m128 outside = _mm_setzero_ps(), intersects = _mm_setzero_ps();
+        for (unsigned int i = 0; i < Frustum::NUM_PLANES; i++) {
+            const glm::vec4& plane = frustum.getPlane(i);
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)), _mm_mul_ps(cy, _mm_set1_ps(plane.y))),
+                                         _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(std::abs(plane.x))), _mm_mul_ps(ey, _mm_set1_ps(std::abs(plane.y)))),
+                                       _mm_mul_ps(ez, _mm_set1_ps(std::abs(plane.z))));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, _mm_sub_ps(_mm_setzero_ps(), radius)));
+            intersects = _mm_or_ps(intersects, _mm_cmplt_ps(distance, radius));
+        }
+        int outsideMask = _mm_movemask_ps(outside), intersectsMask = _mm_movemask_ps(intersects);
+        for (int lane = 0; lane < 4; lane++)
+            results[first + lane] = (outsideMask >> lane) & 1 ? FRUSTUM_OUTSIDE : (intersectsMask >> lane) & 1 ? FRUSTUM_INTERSECTS : FRUSTUM_INSIDE;
+#else
+        for (size_t i = first; i < first + 4; i++) {
+            glm::vec3 center(centers[0][i], centers[1][i], centers[2][i]), extent(extents[0][i], extents[1][i], extents[2][i]);
+            results[i] = frustum.testBox(center - extent, center + extent);
+        }
+#endif
+    }
+};
@@ -1,5 +1,8 @@
 #pragma once
-#include "Model.h"
+#include "ModelRegistry.h"
+#include "LODSelector.h"
+#include "RenderQueue.h"
+#include "Frustum.h"
 
 /**
  * Basic Container for a regular in-game object. 
@@ -8,10 +11,19 @@
 class GameObject {
 
 protected:
-    Model model;    
+    std::shared_ptr<Model> model; // shared with every other GameObject that uses the same file
     glm::vec3 trans, scale, rotAngs;
     const char* filepath;
     bool destroyed = false;
+    unsigned int lod = 0; // level of detail the model is drawn at
+    bool impostor = false; // if true, the object is far away and drawn by an ImpostorAtlas instead
+
+    // world space bounds of the model, recomputed by updateBounds() when the transform changes or more meshes are uploaded
+    glm::vec3 worldBoundsMin = glm::vec3(0.0f), worldBoundsMax = glm::vec3(0.0f);
+    glm::vec3 worldCenter = glm::vec3(0.0f);
+    float worldRadius = 0.0f;
+    bool boundsDirty = true;
+    size_t boundsMeshCount = 0; // meshes of the model the bounds were computed from
 
 public:
     /**
@@ -23,20 +35,97 @@ public:
 	 * Creates a game object using the OBJ file at the specified relative path, with provided translation, size scale, and rotation values. 
      * The object will try to load any textures inside the provided directory and map them onto the object.
      */
-    GameObject(const char* filepath, glm::vec3 defTrans, glm::vec3 defScale, glm::vec3 defRot) : filepath(filepath), model(filepath), trans(defTrans), scale(defScale), rotAngs(defRot) {}
+    GameObject(const char* filepath, glm::vec3 defTrans, glm::vec3 defScale, glm::vec3 defRot) : filepath(filepath), model(ModelRegistry::instance().acquire(filepath)), trans(defTrans), scale(defScale), rotAngs(defRot) {}
+
+    virtual ~GameObject() {}
 
     void draw(Shader* shader) {
-        if (!destroyed) {
-            model.Draw(*shader);
+        if (!destroyed && !impostor) {
+            model->Draw(*shader, lod);
+        }
+    }
+
+    /**
+     * Adds the draws of the object's meshes to a render queue, unless it is destroyed or drawn as an impostor.
+     * @param frustum if set, the object straddles it and each of its meshes is culled against it on its own
+     * @param stats counts the meshes culled and kept when a frustum is given
+     */
+    void enqueue(RenderQueue& queue, Shader* shader, const Frustum* frustum = nullptr, CullStats* stats = nullptr) {
+        if (destroyed || impostor)
+            return;
+        glm::mat4 modelMatrix = getModel();
+        uint32_t transform = queue.addTransform(modelMatrix);
+        // a single mesh has the object's own bounds, which were already tested
+        bool cullMeshes = frustum && model->meshes.size() > 1;
+        for (Mesh& mesh : model->meshes) {
+            if (cullMeshes) {
+                glm::vec3 meshMin, meshMax;
+                TransformBoundingBox(modelMatrix, mesh.boundsMin, mesh.boundsMax, meshMin, meshMax);
+                bool visible = frustum->testBox(meshMin, meshMax) != FRUSTUM_OUTSIDE;
+                if (stats)
+                    (visible ? stats->meshesVisible : stats->meshesCulled)++;
+                if (!visible)
+                    continue;
+            }
+            queue.add(RENDER_PASS_OPAQUE, shader, &mesh, lod, transform, trans);
         }
     }
 
+    /**
+     * Recomputes the world space bounding box and sphere if the transform changed, or if the model got more meshes
+     * since (models load in the background).
+     */
+    void updateBounds() {
+        if (!boundsDirty && boundsMeshCount == model->meshes.size())
+            return;
+        glm::mat4 modelMatrix = getModel();
+        TransformBoundingBox(modelMatrix, model->boundsMin, model->boundsMax, worldBoundsMin, worldBoundsMax);
+        worldCenter = glm::vec3(modelMatrix * glm::vec4(model->boundingCenter, 1.0f));
+        worldRadius = model->boundingRadius * std::max(std::abs(scale.x), std::max(std::abs(scale.y), std::abs(scale.z)));
+        boundsDirty = false;
+        boundsMeshCount = model->meshes.size();
+    }
+
+    /**
+     * Gets the world space bounds as of the last updateBounds().
+     */
+    const glm::vec3& getWorldBoundsMin() const {
+        return worldBoundsMin;
+    }
+
+    const glm::vec3& getWorldBoundsMax() const {
+        return worldBoundsMax;
+    }
+
+    const glm::vec3& getWorldCenter() const {
+        return worldCenter;
+    }
+
+    float getWorldRadius() const {
+        return worldRadius;
+    }
+
+    /**
+     * Picks the level of detail to draw the object at, from the size of its bounding sphere as seen from the camera.
+     * @param fovY vertical field of view of the camera, in radians
+     */
+    void updateLOD(const LODSelector& selector, const glm::vec3& cameraPosition, float fovY) {
+        updateBounds();
+        lod = selector.select(LODSelector::getScreenSize(worldCenter, worldRadius, cameraPosition, fovY), lod, model->getLODCount());
+    }
+
+    unsigned int getLOD() {
+        return lod;
+    }
+
     void setTranslation(glm::vec3 trans) {
         this->trans = trans;
+        boundsDirty = true;
     }
 
     void setRotation(glm::vec3 rot) {
         this->rotAngs = rot;
+        boundsDirty = true;
     }
 
     glm::vec3 getTranslation() {
@@ -65,12 +154,31 @@ public:
 
     void setScale(glm::vec3 scale) {
         this->scale = scale;
+        boundsDirty = true;
     }
 
     const char* getObjFilePath() {
         return filepath;
     }
 
+    /**
+     * Gets the model drawn by this object, shared with every other GameObject using the same file.
+     */
+    std::shared_ptr<Model> getSharedModel() {
+        return model;
+    }
+
+    /**
+     * Sets whether the object is currently drawn as an impostor, in which case draw() does nothing.
+     */
+    void setImpostor(bool impostor) {
+        this->impostor = impostor;
+    }
+
+    bool isImpostor() {
+        return impostor;
+    }
+
     /**
      * Method which can be used to prevent the GameObject from displaying, without removing it from OpenGL. 
      */
@@ -0,0 +1,355 @@
+#pragma once
+#include <glad.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <mutex>
+#include <iostream>
+
+/**
+ * Kinds of OpenGL objects owned through a GpuHandle.
+ */
+enum GpuObjectType {
+    GPU_OBJECT_BUFFER,
+    GPU_OBJECT_VERTEX_ARRAY,
+    GPU_OBJECT_TEXTURE,
+    GPU_OBJECT_PROGRAM,
+    GPU_OBJECT_TYPE_COUNT
+};
+
+/**
+ * What the GPU memory of an object is used for, as reported by the GpuResourceRegistry.
+ */
+enum GpuResourceCategory {
+    GPU_UNCATEGORIZED,
+    GPU_VERTEX_BUFFER,
+    GPU_INDEX_BUFFER,
+    GPU_INSTANCE_BUFFER,
+    GPU_STAGING_BUFFER, // pixel buffers textures are streamed through
+    GPU_UNIFORM_BUFFER,
+    GPU_TEXTURE,
+    GPU_CATEGORY_COUNT
+};
+
+/**
+ * Process-wide accounting of the OpenGL objects alive through GpuHandles: how many of each type, and how much GPU
+ * memory they use by category and by owning asset. The memory of an object is whatever its owner reports with
+ * GpuHandle::setMemory, since OpenGL has no portable way to query it.
+ *
+ * A budget can be set to be warned the first time the live memory goes over it.
+ * Thread-safe, although objects are only created and deleted on the GL thread.
+ */
+class GpuResourceRegistry {
+public:
+    /**
+     * Gets the single registry used by the whole game.
+     */
+    static GpuResourceRegistry& instance() {
+        // never destroyed, so handles owned by other singletons can still untrack themselves at exit
+        static GpuResourceRegistry* registry = new GpuResourceRegistry();
+        return *registry;
+    }
+
+    /**
+     * Starts tracking a newly created object, without any memory.
+     */
+    void add(GpuObjectType type, unsigned int name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        resources[getKey(type, name)] = Resource();
+        liveCounts[type]++;
+    }
+
+    /**
+     * Stops tracking a deleted object.
+     */
+    void remove(GpuObjectType type, unsigned int name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = resources.find(getKey(type, name));
+        if (found == resources.end())
+            return;
+        categoryBytes[found->second.category] -= found->second.bytes;
+        liveBytes -= found->second.bytes;
+        liveCounts[type]--;
+        resources.erase(found);
+    }
+
+    /**
+     * Sets the GPU memory used by an object, replacing what was reported before (e.g. when a buffer is reallocated).
+     */
+    void setMemory(GpuObjectType type, unsigned int name, size_t bytes, GpuResourceCategory category) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = resources.find(getKey(type, name));
+        if (found == resources.end())
+            return;
+        Resource& resource = found->second;
+        categoryBytes[resource.category] -= resource.bytes;
+        liveBytes -= resource.bytes;
+        resource.bytes = bytes;
+        resource.category = category;
+        categoryBytes[category] += bytes;
+        liveBytes += bytes;
+        if (budget > 0 && liveBytes > budget && !warnedOverBudget) {
+            warnedOverBudget = true;
+            std::cout << "WARNING::GPU_RESOURCES:: " << liveBytes / (1024 * 1024) << " MB in use, over the budget of "
+                      << budget / (1024 * 1024) << " MB\n";
+        }
+    }
+
+    /**
+     * Sets the asset an object belongs to, e.g. the path of a model or texture.
+     */
+    void setOwner(GpuObjectType type, unsigned int name, const std::string& owner) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = resources.find(getKey(type, name));
+        if (found != resources.end())
+            found->second.owner = owner;
+    }
+
+    /**
+     * Sets the GPU memory the game is expected to stay under; 0 for no budget.
+     */
+    void setBudget(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        budget = bytes;
+        warnedOverBudget = false;
+    }
+
+    /**
+     * Checks if the live GPU memory is over the budget.
+     */
+    bool isOverBudget() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return budget > 0 && liveBytes > budget;
+    }
+
+    /**
+     * Gets the GPU memory used by every live object.
+     */
+    size_t getLiveBytes() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return liveBytes;
+    }
+
+    /**
+     * Gets the GPU memory used by the live objects of a category.
+     */
+    size_t getLiveBytes(GpuResourceCategory category) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return categoryBytes[category];
+    }
+
+    /**
+     * Gets the number of live objects of a type.
+     */
+    size_t getLiveCount(GpuObjectType type) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return liveCounts[type];
+    }
+
+    /**
+     * Gets the GPU memory used by the live objects of each owner. Objects without an owner are listed under "(unowned)".
+     */
+    std::map<std::string, size_t> getBytesByOwner() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<std::string, size_t> owners;
+        for (const auto& pair : resources)
+            owners[pair.second.owner.empty() ? "(unowned)" : pair.second.owner] += pair.second.bytes;
+        return owners;
+    }
+
+    /**
+     * Checks if the GL context still exists, i.e. if deleting objects still has to go through OpenGL.
+     */
+    bool hasContext() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return contextAlive;
+    }
+
+    /**
+     * Must be called right before the GL context is destroyed. The context frees every object along with it,
+     * so handles destroyed afterwards (e.g. owned by singletons or static objects) only stop being tracked.
+     */
+    void releaseContext() {
+        std::lock_guard<std::mutex> lock(mutex);
+        contextAlive = false;
+    }
+
+    /**
+     * Prints the live objects by type, their memory by category, and the owners using the most memory.
+     */
+    void printStats(unsigned int maxOwners = 10) const {
+        static const char* TYPE_NAMES[GPU_OBJECT_TYPE_COUNT] = { "buffers", "vertex arrays", "textures", "programs" };
+        static const char* CATEGORY_NAMES[GPU_CATEGORY_COUNT] = { "other", "vertex", "index", "instance", "staging", "uniform", "texture" };
+        std::map<std::string, size_t> owners = getBytesByOwner();
+        std::lock_guard<std::mutex> lock(mutex);
+        std::cout << "GPU Resources:";
+        for (unsigned int type = 0; type < GPU_OBJECT_TYPE_COUNT; type++)
+            std::cout << (type ? ", " : " ") << liveCounts[type] << " " << TYPE_NAMES[type];
+        std::cout << "\nGPU Resources: " << liveBytes / (1024 * 1024) << " MB in use (";
+        for (unsigned int category = 0; category < GPU_CATEGORY_COUNT; category++)
+            std::cout << (category ? ", " : "") << CATEGORY_NAMES[category] << " " << categoryBytes[category] / 1024 << " KB";
+        std::cout << ")";
+        if (budget > 0)
+            std::cout << ", budget " << budget / (1024 * 1024) << " MB";
+        std::cout << "\n";
+
+        std::vector<std::pair<std::string, size_t>> largest(owners.begin(), owners.end());
+        std::sort(largest.begin(), largest.end(), [](const std::pair<std::string, size_t>& a, const std::pair<std::string, size_t>& b) {
+            return a.second > b.second;
+        });
+        for (size_t i = 0; i < largest.size() && i < maxOwners; i++)
+            std::cout << "    " << largest[i].first << ": " << largest[i].second / 1024 << " KB\n";
+    }
+
+private:
+    struct Resource {
+        GpuResourceCategory category = GPU_UNCATEGORIZED;
+        size_t bytes = 0;
+        std::string owner;
+    };
+
+    mutable std::mutex mutex;
+    std::unordered_map<uint64_t, Resource> resources; // keyed by type and name, see getKey
+    size_t liveCounts[GPU_OBJECT_TYPE_COUNT] = {};
+    size_t categoryBytes[GPU_CATEGORY_COUNT] = {};
+    size_t liveBytes = 0;
+    size_t budget = 0;
+    bool warnedOverBudget = false;
+    bool contextAlive = true;
+
+    GpuResourceRegistry() {}
+    GpuResourceRegistry(const GpuResourceRegistry&) = delete;
+    GpuResourceRegistry& operator=(const GpuResourceRegistry&) = delete;
+
+    // names are only unique per type of object
+    static uint64_t getKey(GpuObjectType type, unsigned int name) {
+        return ((uint64_t)type << 32) | name;
+    }
+};
+
+/**
+ * Creates a new OpenGL object of a type and returns its name. Must be called on the GL thread.
+ */
+inline unsigned int CreateGpuObject(GpuObjectType type) {
+    unsigned int name = 0;
+    switch (type) {
+    case GPU_OBJECT_BUFFER:       glGenBuffers(1, &name); break;
+    case GPU_OBJECT_VERTEX_ARRAY: glGenVertexArrays(1, &name); break;
+    case GPU_OBJECT_TEXTURE:      glGenTextures(1, &name); break;
+    case GPU_OBJECT_PROGRAM:      name = glCreateProgram(); break;
+    default: break;
+    }
+    return name;
+}
+
+/**
+ * Deletes an OpenGL object. Must be called on the GL thread.
+ */
+inline void DeleteGpuObject(GpuObjectType type, unsigned int name) {
+    switch (type) {
+    case GPU_OBJECT_BUFFER:       glDeleteBuffers(1, &name); break;
+    case GPU_OBJECT_VERTEX_ARRAY: glDeleteVertexArrays(1, &name); break;
+    case GPU_OBJECT_TEXTURE:      glDeleteTextures(1, &name); break;
+    case GPU_OBJECT_PROGRAM:      glDeleteProgram(name); break;
+    default: break;
+    }
+}
+
+/**
+ * Move-only owner of an OpenGL object, which deletes the object when destroyed and keeps the GpuResourceRegistry
+ * up to date. Name 0 means no object. Handles must be created, reset and destroyed on the GL thread.
+ */
+template <GpuObjectType TYPE>
+class GpuHandle {
+public:
+    GpuHandle() {}
+
+    /**
+     * Takes ownership of an existing object, e.g. a texture created by TextureFromImage.
+     */
+    explicit GpuHandle(unsigned int name) : name(name) {
+        if (name)
+            GpuResourceRegistry::instance().add(TYPE, name);
+    }
+
+    /**
+     * Creates a new object.
+     */
+    static GpuHandle create() {
+        return GpuHandle(CreateGpuObject(TYPE));
+    }
+
+    ~GpuHandle() {
+        reset();
+    }
+
+    GpuHandle(GpuHandle&& other) noexcept : name(other.name) {
+        other.name = 0;
+    }
+
+    GpuHandle& operator=(GpuHandle&& other) noexcept {
+        if (this != &other) {
+            reset();
+            name = other.name;
+            other.name = 0;
+        }
+        return *this;
+    }
+
+    GpuHandle(const GpuHandle&) = delete;
+    GpuHandle& operator=(const GpuHandle&) = delete;
+
+    /**
+     * Gets the name of the object, 0 if there is none.
+     */
+    unsigned int get() const {
+        return name;
+    }
+
+    explicit operator bool() const {
+        return name != 0;
+    }
+
+    /**
+     * Deletes the object, if any, and takes ownership of another one.
+     */
+    void reset(unsigned int newName = 0) {
+        if (name) {
+            GpuResourceRegistry& registry = GpuResourceRegistry::instance();
+            registry.remove(TYPE, name);
+            if (registry.hasContext())
+                DeleteGpuObject(TYPE, name);
+        }
+        name = newName;
+        if (name)
+            GpuResourceRegistry::instance().add(TYPE, name);
+    }
+
+    /**
+     * Records the GPU memory the object uses, replacing what was recorded before.
+     */
+    void setMemory(size_t bytes, GpuResourceCategory category) const {
+        if (name)
+            GpuResourceRegistry::instance().setMemory(TYPE, name, bytes, category);
+    }
+
+    /**
+     * Records the asset the object belongs to.
+     */
+    void setOwner(const std::string& owner) const {
+        if (name)
+            GpuResourceRegistry::instance().setOwner(TYPE, name, owner);
+    }
+
+private:
+    unsigned int name = 0;
+};
+
+typedef GpuHandle<GPU_OBJECT_BUFFER> GLBuffer;
+typedef GpuHandle<GPU_OBJECT_VERTEX_ARRAY> GLVertexArray;
+typedef GpuHandle<GPU_OBJECT_TEXTURE> GLTexture;
+typedef GpuHandle<GPU_OBJECT_PROGRAM> GLProgram;
@@ -10,13 +10,16 @@ class Grass : public InstancedObject {
 public:
 	/**
 	 * Constructs the Instanced object container for all Grass instances with a size of 1024 grass instances
+	 * @param scale size of an average grass instance
 	 */
-	Grass(const char* filepath, Shader* shader) : InstancedObject(filepath, shader, 1024) {
+	Grass(const char* filepath, Shader* shader, glm::vec3 scale) : InstancedObject(filepath, shader, 1024), grassScale(scale) {
 		initModelTransformations();
 		configureInstancedArray();	
 	}
 
 protected:
+	glm::vec3 grassScale;
+
 	/**
 	 * Semi-randomely generates modelView matrices for each grass instance, in a grid-sstyle distribution
 	 */
@@ -40,7 +43,7 @@ protected:
 			modelMat = glm::translate(modelMat, glm::vec3(x, y, z));
 			//std::cout << "ModelMat[" << i << "] x = " << x << " y = " << y << " z = " << z << "\n";
 			float scale = (rand() % 100) / 100 + 0.7f;
-			modelMat = glm::scale(modelMat, glm::vec3(scale * scaleGrass * GLOBAL_SCALE));
+			modelMat = glm::scale(modelMat, glm::vec3(scale * grassScale));
 
 			// rotation: add random rotation around a (semi)randomly picked rotation axis vector
 			float rotY = (rand() % 360);			
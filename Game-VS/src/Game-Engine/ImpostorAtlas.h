@@ -0,0 +1,253 @@
+#pragma once
+#include <glad.h>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/constants.hpp>
+#include "GameObject.h"
+#include "Shader.h"
+#include "GpuResource.h"
+#include "UniformBuffers.h"
+#include "Trace.h"
+
+/**
+ * Draws distant game objects as impostors: camera-facing quads textured with a picture of the model.
+ * Each model is rendered offscreen from NUM_VIEWS directions around its vertical axis into one row of an atlas,
+ * and every impostor shows the view closest to the direction the camera sees it from. All impostors, of any model,
+ * are drawn with a single instanced draw call.
+ *
+ * Objects further than the impostor distance from the camera are flagged with GameObject::setImpostor, so they skip
+ * their own draw, and are drawn by the atlas instead. Nearer objects are drawn with their full geometry as usual.
+ * All methods must be called on the GL thread.
+ */
+class ImpostorAtlas {
+public:
+    // number of directions each model is rendered from, evenly spread around its vertical axis
+    static const unsigned int NUM_VIEWS = 8;
+    // size in pixels of the square atlas cell of each view
+    static const unsigned int CELL_SIZE = 256;
+
+    /**
+     * @param distance distance from the camera beyond which objects are drawn as impostors
+     */
+    explicit ImpostorAtlas(float distance) : distance(distance) {}
+
+    ImpostorAtlas(const ImpostorAtlas&) = delete;
+    ImpostorAtlas& operator=(const ImpostorAtlas&) = delete;
+
+    /**
+     * Adds a game object to be drawn as an impostor when far away. Objects sharing a model share one atlas row.
+     * Must be called before bake().
+     */
+    void addObject(GameObject* object) {
+        std::shared_ptr<Model> model = object->getSharedModel();
+        auto row = rows.find(model.get());
+        if (row == rows.end()) {
+            row = rows.emplace(model.get(), (unsigned int)models.size()).first;
+            models.push_back(model);
+        }
+        objects.push_back({ object, row->second });
+    }
+
+    bool isBaked() const {
+        return baked;
+    }
+
+    /**
+     * Gets the number of objects drawn as impostors this frame.
+     */
+    unsigned int getImpostorCount() const {
+        return (unsigned int)instances.size();
+    }
+
+    /**
+     * Renders every model into the atlas, with the model shader. The models must be fully loaded, textures included,
+     * so the pictures don't show placeholders. Returns false if the offscreen framebuffer couldn't be created.
+     */
+    bool bake(Shader& shader) {
+        if (models.empty() || baked)
+            return baked;
+        TRACE_SCOPE("upload", "ImpostorAtlas::bake");
+
+        // keep the state the render loop relies on
+        GLint previousFramebuffer, viewport[4];
+        GLfloat clearColor[4];
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+        GLboolean blend = glIsEnabled(GL_BLEND);
+
+        GLsizei width = NUM_VIEWS * CELL_SIZE, height = (GLsizei)models.size() * CELL_SIZE;
+        atlasTexture = GLTexture::create();
+        glBindTexture(GL_TEXTURE_2D, atlasTexture.get());
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        unsigned int depth, framebuffer;
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, atlasTexture.get(), 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+
+        bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        if (complete) {
+            // pixels no geometry covers stay transparent, which the impostor shader discards
+            glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            glDisable(GL_BLEND);
+            // the views go through the shared camera and a single identity transform, like the objects drawn each frame
+            UniformBuffers& uniforms = UniformBuffers::instance();
+            uniforms.setTransforms(std::vector<glm::mat4>(1, glm::mat4(1.0f)));
+            shader.use();
+            shader.setInt(UNIFORM_TRANSFORM_INDEX, 0);
+            for (unsigned int row = 0; row < models.size(); row++) {
+                Model& model = *models[row];
+                float radius = std::max(model.boundingRadius, 0.001f);
+                // an orthographic box around the bounding sphere, matching the quad drawn for the impostor
+                glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, 0.0f, 4.0f * radius);
+                for (unsigned int view = 0; view < NUM_VIEWS; view++) {
+                    glm::vec3 eye = model.boundingCenter + getViewDirection(view) * (2.0f * radius);
+                    uniforms.setCamera(projection, glm::lookAt(eye, model.boundingCenter, glm::vec3(0.0f, 1.0f, 0.0f)), eye);
+                    glViewport(view * CELL_SIZE, row * CELL_SIZE, CELL_SIZE, CELL_SIZE);
+                    model.Draw(shader);
+                }
+            }
+            glBindTexture(GL_TEXTURE_2D, atlasTexture.get());
+            glGenerateMipmap(GL_TEXTURE_2D);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        else
+            std::cout << "ERROR::IMPOSTOR_ATLAS:: offscreen framebuffer is not complete" << std::endl;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(1, &depth);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+        if (blend)
+            glEnable(GL_BLEND);
+        if (!complete) {
+            atlasTexture.reset();
+            return false;
+        }
+        // RGBA8 with a full mipmap chain
+        atlasTexture.setMemory((size_t)width * height * 4 * 4 / 3, GPU_TEXTURE);
+        atlasTexture.setOwner("impostor atlas");
+
+        setupBuffers();
+        baked = true;
+        std::cout << "Baked impostors of " << models.size() << " models into a " << width << "x" << height << " atlas\n";
+        return true;
+    }
+
+    /**
+     * Switches each object between its full geometry and its impostor by distance to the camera, and gathers the impostors to draw.
+     */
+    void update(const glm::vec3& cameraPosition) {
+        instances.clear();
+        if (!baked)
+            return;
+        for (const ImpostorObject& impostor : objects) {
+            GameObject& object = *impostor.object;
+            const Model& model = *models[impostor.row];
+            glm::vec3 center = glm::vec3(object.getModel() * glm::vec4(model.boundingCenter, 1.0f));
+            glm::vec3 scale = glm::abs(object.getScale());
+            bool distant = !object.isDestroyed() && glm::length(center - cameraPosition) > distance;
+            object.setImpostor(distant);
+            if (!distant)
+                continue;
+            Instance instance;
+            instance.center = center;
+            instance.radius = model.boundingRadius * std::max(scale.x, std::max(scale.y, scale.z));
+            instance.yaw = glm::radians(object.getRotationAngles().y);
+            instance.row = (float)impostor.row;
+            instances.push_back(instance);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO.get());
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(Instance), instances.empty() ? nullptr : instances.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        instanceVBO.setMemory(instances.size() * sizeof(Instance), GPU_INSTANCE_BUFFER);
+    }
+
+    /**
+     * Draws every impostor gathered by the last update(), with the camera of the frame uploaded to the UniformBuffers.
+     */
+    void draw(Shader& shader) {
+        if (!baked || instances.empty())
+            return;
+        shader.use();
+        shader.setInt("numViews", NUM_VIEWS);
+        shader.setInt("numRows", (int)models.size());
+        shader.setInt("impostorAtlas", 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, atlasTexture.get());
+        glBindVertexArray(VAO.get());
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)instances.size());
+        glBindVertexArray(0);
+    }
+
+private:
+    struct ImpostorObject {
+        GameObject* object;
+        unsigned int row;
+    };
+
+    // per instance attributes, see impostor.vs
+    struct Instance {
+        glm::vec3 center; // world space center of the bounding sphere
+        float radius;
+        float yaw;        // rotation of the object around the vertical axis, in radians
+        float row;        // atlas row of the object's model
+    };
+
+    float distance;
+    std::vector<std::shared_ptr<Model>> models; // one per atlas row
+    std::map<const Model*, unsigned int> rows;
+    std::vector<ImpostorObject> objects;
+    std::vector<Instance> instances;
+    bool baked = false;
+    GLTexture atlasTexture;
+    GLVertexArray VAO;
+    GLBuffer quadVBO, instanceVBO;
+
+    // direction from the model towards the camera of a view, in model space. View 0 looks at the model's front (+z)
+    static glm::vec3 getViewDirection(unsigned int view) {
+        float angle = 2.0f * glm::pi<float>() * view / NUM_VIEWS;
+        return glm::vec3(std::sin(angle), 0.0f, std::cos(angle));
+    }
+
+    void setupBuffers() {
+        static const float CORNERS[] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+        VAO = GLVertexArray::create();
+        quadVBO = GLBuffer::create();
+        instanceVBO = GLBuffer::create();
+        glBindVertexArray(VAO.get());
+        glBindBuffer(GL_ARRAY_BUFFER, quadVBO.get());
+        glBufferData(GL_ARRAY_BUFFER, sizeof(CORNERS), CORNERS, GL_STATIC_DRAW);
+        quadVBO.setMemory(sizeof(CORNERS), GPU_VERTEX_BUFFER);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO.get());
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)offsetof(Instance, center));
+        glVertexAttribDivisor(1, 1);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)offsetof(Instance, yaw));
+        glVertexAttribDivisor(2, 1);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        VAO.setOwner("impostor atlas");
+        quadVBO.setOwner("impostor atlas");
+        instanceVBO.setOwner("impostor atlas");
+    }
+};
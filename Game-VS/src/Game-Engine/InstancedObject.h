@@ -8,35 +8,50 @@ public:
 	/**
 	 * Constructs an instanced object from a OBJ filepath and a shader.
 	 */
-	InstancedObject(const char* filepath, Shader* shader, int numInstances) : model(filepath), shader(shader), numInstances(numInstances) {
+	InstancedObject(const char* filepath, Shader* shader, int numInstances) : model(ModelRegistry::instance().acquire(filepath, MODEL_INSTANCED)), shader(shader), numInstances(numInstances) {
 		rotAngs = new float[numInstances];
 		modelMatrices = new glm::mat4[numInstances];
 	}
 
+	virtual ~InstancedObject() {
+		delete[] rotAngs;
+		delete[] modelMatrices;
+	}
+
+	InstancedObject(const InstancedObject&) = delete;
+	InstancedObject& operator=(const InstancedObject&) = delete;
+
 	/**
-	 * Draws the instanced object using the provided project and view matrices
+	 * Draws the instanced object, with the camera of the frame uploaded to the UniformBuffers
 	 */
-	void drawInstances(glm::mat4 projection, glm::mat4 view) {
+	void drawInstances() {
 		shader->use();
-		shader->setMat4("projection", projection);
-		shader->setMat4("view", view);
-		shader->setInt("texture_diffuse1", 0);
+		// every mesh is drawn with the model's first texture
+		if (diffuseGeneration != materialGeneration && !model->textures_loaded.empty()) {
+			hasDiffuse = ResolveMaterialBinding(*shader, "texture_diffuse1", model->textures_loaded[0], diffuseBinding);
+			diffuseGeneration = materialGeneration;
+		}
+		if (hasDiffuse)
+			ApplyMaterialBinding(diffuseBinding);
 		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, model.textures_loaded[0].id);
-		for (unsigned int i = 0; i < model.meshes.size(); i++) {
-			glBindVertexArray(model.meshes[i].VAO);
-			glDrawElementsInstanced(GL_TRIANGLES, model.meshes[i].indices.size(), GL_UNSIGNED_INT, 0, numInstances);
+		for (unsigned int i = 0; i < model->meshes.size(); i++) {
+			glBindVertexArray(model->meshes[i].VAO.get());
+			glDrawElementsInstanced(GL_TRIANGLES, model->meshes[i].getIndexCount(0), GL_UNSIGNED_INT, 0, numInstances);
 			glBindVertexArray(0);
 		}
 	}
 protected:
 
 	Shader* shader;
-	Model model;
+	std::shared_ptr<Model> model; // this object's own copy, since instancing adds attributes to its VAOs
+	MaterialBinding diffuseBinding; // the model's first texture, resolved for the shader as of diffuseGeneration
+	bool hasDiffuse = false;
+	unsigned int diffuseGeneration = ~0u;
 
 	unsigned int numInstances;
 	glm::mat4* modelMatrices;// size = numInstances
 	float* rotAngs; // array holding the rotation (euler) angles of the instances. size = numInstances. Not necisarily used by inheriting class 
+	GLBuffer instanceBuffer; // model matrices of the instances, deleted along with the object
 
 	/**
 	 * Method that can be implemented by the inheriting class to generate the locations of the instances in a custom way.
@@ -47,18 +62,19 @@ protected:
 	void configureInstancedArray() {
 		// configure instanced array
 		// -------------------------
-		unsigned int buffer;
-		glGenBuffers(1, &buffer);
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		instanceBuffer = GLBuffer::create();
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer.get());
 		glBufferData(GL_ARRAY_BUFFER, numInstances * sizeof(glm::mat4), &modelMatrices[0], GL_STATIC_DRAW);
+		instanceBuffer.setMemory(numInstances * sizeof(glm::mat4), GPU_INSTANCE_BUFFER);
+		instanceBuffer.setOwner(model->path + "#instances");
 
 		// set transformation matrices as an instance vertex attribute (with divisor 1)
 		// note: we're cheating a little by taking the, now publicly declared, VAO of the model's mesh(es) and adding new vertexAttribPointers
 		// normally you'd want to do this in a more organized fashion, but for learning purposes this will do.
 		// -----------------------------------------------------------------------------------------------------------------------------------
-		for (unsigned int i = 0; i < model.meshes.size(); i++)
+		for (unsigned int i = 0; i < model->meshes.size(); i++)
 		{
-			unsigned int VAO = model.meshes[i].VAO;
+			unsigned int VAO = model->meshes[i].VAO.get();
 			glBindVertexArray(VAO);
 			// set attribute pointers for matrix (4 times vec4)
 			glEnableVertexAttribArray(3);
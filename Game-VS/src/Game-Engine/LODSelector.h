@@ -0,0 +1,51 @@
+#pragma once
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+/**
+ * Picks the level of detail of an object from the size of its bounding sphere on screen, as a fraction of the viewport
+ * height. Each threshold is the screen size below which the next coarser level is used, from the finest level down.
+ * An object only changes level once its size is past a threshold by the hysteresis margin, so objects hovering around
+ * a threshold don't keep popping between two levels.
+ */
+class LODSelector {
+public:
+    /**
+     * @param thresholds screen sizes at which to switch to level 1, 2, ..., in decreasing order
+     * @param hysteresis margin around each threshold, as a fraction of it
+     */
+    LODSelector(const float* thresholds, unsigned int numThresholds, float hysteresis)
+        : thresholds(thresholds, thresholds + numThresholds), hysteresis(hysteresis) {}
+
+    /**
+     * Gets the fraction of the viewport height covered by a sphere, for a perspective projection.
+     * @param fovY vertical field of view, in radians
+     */
+    static float getScreenSize(const glm::vec3& center, float radius, const glm::vec3& eye, float fovY) {
+        float distance = glm::length(center - eye);
+        if (distance <= radius)
+            return 1.0f; // the camera is inside the sphere
+        return radius / (distance * std::tan(fovY * 0.5f));
+    }
+
+    /**
+     * Gets the level of detail to draw an object at this frame.
+     * @param current level the object was drawn at last frame
+     * @param lodCount number of levels the object has
+     */
+    unsigned int select(float screenSize, unsigned int current, unsigned int lodCount) const {
+        unsigned int maxLevel = std::min(lodCount > 0 ? lodCount - 1 : 0u, (unsigned int)thresholds.size());
+        unsigned int lod = std::min(current, maxLevel);
+        while (lod < maxLevel && screenSize < thresholds[lod] * (1.0f - hysteresis))
+            lod++;
+        while (lod > 0 && screenSize > thresholds[lod - 1] * (1.0f + hysteresis))
+            lod--;
+        return lod;
+    }
+
+private:
+    std::vector<float> thresholds;
+    float hysteresis;
+};
@@ -0,0 +1,92 @@
+///
+/// @file MappedFile.cpp
+///
+/// Platform specific parts of MappedFile. Kept out of the header so that <windows.h> isn't pulled into
+/// every file that includes the OpenGL headers.
+///
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+
+bool MappedFile::open(const std::string& path) {
+    close();
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        CloseHandle(file);
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == NULL) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    fileHandle = file;
+    mappingHandle = mapping;
+    mappedData = static_cast<const unsigned char*>(view);
+    mappedSize = (size_t)fileSize.QuadPart;
+    return true;
+}
+
+void MappedFile::close() {
+    if (mappedData)
+        UnmapViewOfFile(mappedData);
+    if (mappingHandle)
+        CloseHandle((HANDLE)mappingHandle);
+    if (fileHandle)
+        CloseHandle((HANDLE)fileHandle);
+    mappedData = nullptr;
+    mappedSize = 0;
+    fileHandle = mappingHandle = nullptr;
+}
+
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdint>
+
+bool MappedFile::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (view == MAP_FAILED) {
+        ::close(fd);
+        return false;
+    }
+    // the descriptor is stored in the handle slot; +1 so that descriptor 0 isn't mistaken for "no handle"
+    fileHandle = reinterpret_cast<void*>((intptr_t)fd + 1);
+    mappedData = static_cast<const unsigned char*>(view);
+    mappedSize = (size_t)info.st_size;
+    return true;
+}
+
+void MappedFile::close() {
+    if (mappedData)
+        munmap(const_cast<unsigned char*>(mappedData), mappedSize);
+    if (fileHandle)
+        ::close((int)(reinterpret_cast<intptr_t>(fileHandle) - 1));
+    mappedData = nullptr;
+    mappedSize = 0;
+    fileHandle = mappingHandle = nullptr;
+}
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+/**
+ * Read-only memory mapping of a file on disk. The mapping stays valid for the lifetime of the object,
+ * so pointers into data() can be handed directly to OpenGL (e.g. glBufferData) without an intermediate copy.
+ */
+class MappedFile {
+public:
+    MappedFile() {}
+
+    /**
+     * Constructs the mapping and immediately opens the file at the provided path. Check isOpen() for success.
+     */
+    explicit MappedFile(const std::string& path) {
+        open(path);
+    }
+
+    ~MappedFile() {
+        close();
+    }
+
+    // a mapping owns its OS handles, so it can't be copied
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * Maps the whole file at the provided path into memory. Returns false if the file can't be opened or is empty.
+     */
+    bool open(const std::string& path);
+
+    /**
+     * Unmaps the file and releases all OS handles. Safe to call on a closed mapping.
+     */
+    void close();
+
+    bool isOpen() const {
+        return mappedData != nullptr;
+    }
+
+    const unsigned char* data() const {
+        return mappedData;
+    }
+
+    size_t size() const {
+        return mappedSize;
+    }
+
+private:
+    const unsigned char* mappedData = nullptr;
+    size_t mappedSize = 0;
+    // platform specific handles (HANDLEs on Windows, a file descriptor elsewhere)
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+};
@@ -3,128 +3,414 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include "Shader.h"
+#include "VertexLayout.h"
+#include "GpuResource.h"
 #include <string>
 #include <vector>
+#include <algorithm>
 
 /**
- * Encasulation of all data for a vertex used by Mesh
+ * Encapsulation of all data about a Texture needed by Mesh
  * source: https://learnopengl.com/Model-Loading/Mesh
  */
-struct Vertex {
-    glm::vec3 Position;
-    glm::vec3 Normal;
-    glm::vec2 TexCoords;
-    glm::vec3 Tangent;
-    glm::vec3 Bitangent;
+struct Texture {
+    unsigned int id;
+    std::string type;
+    std::string path;
+    unsigned int array = 0; // texture array holding the image once packed by the TextureArrayPacker, 0 if not packed
+    float layer = -1.0f;    // layer of the image in the array
 };
 
 /**
- * Encapsulation of all data about a Texture needed by Mesh
- * source: https://learnopengl.com/Model-Loading/Mesh
+ * Texture arrays bound at the units from TEXTURE_ARRAY_UNIT on, so meshes sharing an array don't bind it again.
+ * Only ApplyMaterialBinding binds arrays at those units; code creating or binding arrays elsewhere must call
+ * ResetBoundTextureArrays afterwards.
  */
-struct Texture {
-    unsigned int id;
+inline unsigned int boundTextureArrays[MAX_TEXTURE_ARRAY_UNITS] = {};
+
+inline void ResetBoundTextureArrays() {
+    std::fill(boundTextureArrays, boundTextureArrays + MAX_TEXTURE_ARRAY_UNITS, 0u);
+}
+
+/**
+ * Material texture resolved for a shader: the texture to bind at which unit, and the layer the shader should read
+ * through "<sampler>_layer", negative for the plain texture. A texture packed into an array is bound at the unit of
+ * the "<sampler>_array" sampler instead.
+ */
+struct MaterialBinding {
+    GLenum target = GL_TEXTURE_2D; // GL_TEXTURE_2D, or GL_TEXTURE_2D_ARRAY once packed
+    unsigned int texture = 0;
+    GLint unit = 0;
+    GLint layerLocation = -1;      // location of "<sampler>_layer", -1 if the shader has none
+    float layer = -1.0f;
+
+    bool operator==(const MaterialBinding& other) const {
+        return target == other.target && texture == other.texture && unit == other.unit &&
+               layerLocation == other.layerLocation && layer == other.layer;
+    }
+};
+
+/**
+ * Incremented whenever the textures of meshes are replaced (e.g. packed into arrays), so binding tables are resolved again.
+ */
+inline unsigned int materialGeneration = 0;
+
+inline void InvalidateMaterialBindings() {
+    materialGeneration++;
+}
+
+/**
+ * Resolves a material texture for a sampler of the shader (e.g. "texture_diffuse1").
+ * Returns false if the shader doesn't read the sampler, in which case nothing needs to be bound.
+ */
+inline bool ResolveMaterialBinding(const Shader& shader, const std::string& sampler, const Texture& texture, MaterialBinding& binding) {
+    GLint unit = shader.getSamplerUnit(sampler);
+    if (unit < 0)
+        return false;
+    GLint arrayUnit = shader.getSamplerUnit(sampler + "_array");
+    binding.layerLocation = shader.getUniformLocation(sampler + "_layer");
+    if (texture.array && arrayUnit >= (GLint)TEXTURE_ARRAY_UNIT && arrayUnit < (GLint)(TEXTURE_ARRAY_UNIT + MAX_TEXTURE_ARRAY_UNITS)) {
+        binding.target = GL_TEXTURE_2D_ARRAY;
+        binding.texture = texture.array;
+        binding.unit = arrayUnit;
+        binding.layer = texture.layer;
+    }
+    else {
+        binding.target = GL_TEXTURE_2D;
+        binding.texture = texture.id;
+        binding.unit = unit;
+        binding.layer = -1.0f;
+    }
+    return true;
+}
+
+/**
+ * Binds a resolved material texture. An array is only bound if it isn't bound at its unit already.
+ */
+inline void ApplyMaterialBinding(const MaterialBinding& binding) {
+    if (binding.layerLocation >= 0)
+        glUniform1f(binding.layerLocation, binding.layer);
+    if (binding.target == GL_TEXTURE_2D_ARRAY) {
+        unsigned int& bound = boundTextureArrays[binding.unit - TEXTURE_ARRAY_UNIT];
+        if (bound == binding.texture)
+            return;
+        bound = binding.texture;
+    }
+    glActiveTexture(GL_TEXTURE0 + binding.unit);
+    glBindTexture(binding.target, binding.texture);
+}
+
+/**
+ * Reference to a texture used by a mesh's material: the sampler type name and the file path relative to the model's directory.
+ */
+struct TextureRef {
     std::string type;
     std::string path;
 };
 
+/**
+ * Range of a mesh's index buffer holding one level of detail. Level 0 is the full mesh; every level indexes the same vertices.
+ */
+struct MeshLOD {
+    unsigned int indexOffset = 0;
+    unsigned int indexCount = 0;
+    float error = 0.0f; // simplification error, as a fraction of the mesh's bounding radius
+};
+
+/**
+ * CPU-side view of a mesh's data before it is uploaded. The vertex and index arrays are owned elsewhere
+ * (e.g. by an imported model or a mapped mesh cache file) and must outlive the view.
+ */
+struct MeshView {
+    const Vertex* vertices = nullptr;
+    unsigned int numVertices = 0;
+    const unsigned int* indices = nullptr;
+    unsigned int numIndices = 0;
+    std::vector<TextureRef> textures;
+    std::vector<MeshLOD> lods; // levels of detail inside the indices, empty if the mesh only has the full level
+};
+
+/**
+ * What a mesh keeps in system memory once its vertices and indices have been uploaded to the GPU.
+ * The bounding sphere and box, and the levels of detail, are always kept; drawing needs them.
+ */
+enum MeshResidency {
+    RESIDENCY_KEEP_ALL,    // keep the vertices and indices
+    RESIDENCY_KEEP_BOUNDS, // keep only a collision proxy: the positions and indices of the coarsest level of detail
+    RESIDENCY_RELEASE_ALL  // keep nothing but the bounds
+};
+
 /**
  * Encapsulation of a Mesh's data and operations
  * source: https://learnopengl.com/Model-Loading/Mesh
  */
 class Mesh {
 public:
+    // maximum number of levels of detail of a mesh, including the full mesh
+    static const unsigned int MAX_LODS = 4;
+
     // mesh Data
-    std::vector<Vertex>       vertices;
-    std::vector<unsigned int> indices;
+    std::vector<Vertex>       vertices; // empty unless the residency is RESIDENCY_KEEP_ALL
+    std::vector<unsigned int> indices;  // empty unless the residency is RESIDENCY_KEEP_ALL
     std::vector<Texture>      textures;
-    unsigned int VAO;
+    GLVertexArray VAO;
+    unsigned int vertexCount = 0;            // number of vertices in the vertex buffer
+    unsigned int indexCount = 0;             // number of indices in the index buffer, of all levels of detail
+    VertexFormat vertexFormat = VERTEX_FULL; // format the vertices were uploaded in
+    MeshResidency residency = RESIDENCY_KEEP_ALL;
+    std::vector<MeshLOD> lods;               // levels of detail, always at least the full mesh
+    glm::vec3 boundingCenter = glm::vec3(0.0f);
+    float boundingRadius = 0.0f;
+    glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f);
+    std::vector<glm::vec3> collisionVertices;     // collision proxy, only kept with RESIDENCY_KEEP_BOUNDS
+    std::vector<unsigned int> collisionIndices;
 
     /**
      * Constructs a mesh from vertices, indeces and textures. Mesh is intialized upon construction.
      */
-    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures) {
+    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, VertexFormat format = VERTEX_FULL) {
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
-        setupMesh();
+        setupBounds(this->vertices.data(), this->vertices.size(), this->indices.size(), std::vector<MeshLOD>());
+        setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size(), format);
+    }
+
+    /**
+     * Constructs a mesh from raw vertex and index arrays, e.g. arrays inside a mapped mesh cache file.
+     * The arrays are uploaded to the GPU directly from the provided memory, unless they have to be packed first.
+     * @param lods levels of detail inside the indices; if empty, all indices are the only level
+     * @param residency what to keep in system memory; the arrays are only copied if the mesh keeps them
+     */
+    Mesh(const Vertex* vertexData, size_t numVertices, const unsigned int* indexData, size_t numIndices, std::vector<Texture> textures,
+         VertexFormat format = VERTEX_FULL, const std::vector<MeshLOD>& lods = std::vector<MeshLOD>(),
+         MeshResidency residency = RESIDENCY_KEEP_ALL)
+        : textures(textures), residency(residency) {
+        if (residency == RESIDENCY_KEEP_ALL) {
+            vertices.assign(vertexData, vertexData + numVertices);
+            indices.assign(indexData, indexData + numIndices);
+        }
+        setupBounds(vertexData, numVertices, numIndices, lods);
+        if (residency == RESIDENCY_KEEP_BOUNDS)
+            buildCollisionProxy(vertexData, indexData);
+        setupMesh(vertexData, numVertices, indexData, numIndices, format);
+    }
+
+    /**
+     * Records the asset the mesh's GPU buffers belong to, e.g. the path of its model, in the GpuResourceRegistry.
+     */
+    void setOwner(const std::string& owner) const {
+        VAO.setOwner(owner);
+        VBO.setOwner(owner);
+        EBO.setOwner(owner);
+    }
+
+    /**
+     * Drops the vertices and indices kept in system memory, keeping what the residency asks for.
+     * Returns the number of bytes released.
+     */
+    size_t releaseCpuData(MeshResidency newResidency) {
+        if (newResidency <= residency)
+            return 0;
+        size_t before = getCpuBytes();
+        if (newResidency == RESIDENCY_KEEP_BOUNDS && !vertices.empty())
+            buildCollisionProxy(vertices.data(), indices.data());
+        else if (newResidency == RESIDENCY_RELEASE_ALL) {
+            std::vector<glm::vec3>().swap(collisionVertices);
+            std::vector<unsigned int>().swap(collisionIndices);
+        }
+        std::vector<Vertex>().swap(vertices);
+        std::vector<unsigned int>().swap(indices);
+        residency = newResidency;
+        return before - getCpuBytes();
+    }
+
+    /**
+     * Gets the system memory used by the geometry the mesh keeps: vertices, indices and collision proxy.
+     */
+    size_t getCpuBytes() const {
+        return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int) +
+               collisionVertices.capacity() * sizeof(glm::vec3) + collisionIndices.capacity() * sizeof(unsigned int);
+    }
+
+    /**
+     * Gets the system memory the vertices and indices would use if the mesh kept them.
+     */
+    size_t getFullCpuBytes() const {
+        return (size_t)vertexCount * sizeof(Vertex) + (size_t)indexCount * sizeof(unsigned int);
+    }
+
+    /**
+     * Gets the GPU memory used by the vertex buffer.
+     */
+    size_t getVertexBytes() const {
+        return (size_t)vertexCount * (vertexFormat == VERTEX_PACKED ? sizeof(PackedVertex) : sizeof(Vertex));
+    }
+
+    /**
+     * Gets the number of levels of detail of the mesh.
+     */
+    unsigned int getLODCount() const {
+        return (unsigned int)lods.size();
+    }
+
+    /**
+     * Gets the number of indices drawn for a level of detail, clamped to the coarsest level.
+     */
+    unsigned int getIndexCount(unsigned int lod = 0) const {
+        return lods[std::min(lod, getLODCount() - 1)].indexCount;
     }
 
     /**
      * Method which renders the mesh using a specific shader
+     * @param lod level of detail to draw, clamped to the coarsest level the mesh has
+     */
+    void Draw(const Shader& shader, unsigned int lod = 0) {
+        // bind the textures of the material, resolved once for the shader
+        for (const MaterialBinding& binding : getMaterialBindings(shader))
+            ApplyMaterialBinding(binding);
+
+        // draw mesh
+        glBindVertexArray(VAO.get());
+        drawElements(lod);
+        glBindVertexArray(0);
+
+        // always good practice to set everything back to defaults once configured.
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    /**
+     * Gets the textures to bind to draw the mesh with a shader, resolving them if they weren't yet for that shader.
      */
-    void Draw(Shader shader) {
-        // bind appropriate textures
+    const std::vector<MaterialBinding>& getMaterialBindings(const Shader& shader) {
+        if (bindingsProgram != shader.ID || bindingsGeneration != materialGeneration)
+            resolveMaterialBindings(shader);
+        return materialBindings;
+    }
+
+    /**
+     * Draws the triangles of a level of detail, with the mesh's vertex array and textures already bound.
+     */
+    void drawElements(unsigned int lod = 0) const {
+        const MeshLOD& level = lods[std::min(lod, getLODCount() - 1)];
+        glDrawElements(GL_TRIANGLES, level.indexCount, GL_UNSIGNED_INT, (void*)(level.indexOffset * sizeof(unsigned int)));
+    }
+
+private:
+    // render data, deleted along with the mesh
+    GLBuffer VBO, EBO;
+    // textures to bind when drawing, for the program bindingsProgram as of materialGeneration bindingsGeneration
+    std::vector<MaterialBinding> materialBindings;
+    unsigned int bindingsProgram = 0;
+    unsigned int bindingsGeneration = 0;
+
+    /**
+     * Resolves the textures of the mesh into its binding table for a shader. Textures are named after their type and
+     * their number among the textures of that type, e.g. the second diffuse texture is read by "texture_diffuse2".
+     */
+    void resolveMaterialBindings(const Shader& shader) {
+        materialBindings.clear();
         unsigned int diffuseNr = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr = 1;
         unsigned int heightNr = 1;
-        for (unsigned int i = 0; i < textures.size(); i++) {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
+        for (const Texture& texture : textures) {
             // retrieve texture number (the N in diffuse_textureN)
             std::string number;
-            std::string name = textures[i].type;
-            if (name == "texture_diffuse")
+            if (texture.type == "texture_diffuse")
                 number = std::to_string(diffuseNr++);
-            else if (name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if (name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-            else if (name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            else if (texture.type == "texture_specular")
+                number = std::to_string(specularNr++);
+            else if (texture.type == "texture_normal")
+                number = std::to_string(normalNr++);
+            else if (texture.type == "texture_height")
+                number = std::to_string(heightNr++);
+            MaterialBinding binding;
+            if (ResolveMaterialBinding(shader, texture.type + number, texture, binding))
+                materialBindings.push_back(binding);
         }
+        bindingsProgram = shader.ID;
+        bindingsGeneration = materialGeneration;
+    }
 
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    /**
+     * Sets the element counts, the levels of detail, the bounding box and the bounding sphere, which is centered on the box.
+     */
+    void setupBounds(const Vertex* vertexData, size_t numVertices, size_t numIndices, const std::vector<MeshLOD>& levels) {
+        vertexCount = (unsigned int)numVertices;
+        indexCount = (unsigned int)numIndices;
+        lods = levels;
+        if (lods.empty()) {
+            MeshLOD full;
+            full.indexCount = indexCount;
+            lods.push_back(full);
+        }
+        if (numVertices == 0)
+            return;
+        boundsMin = boundsMax = vertexData[0].Position;
+        for (size_t i = 0; i < numVertices; i++) {
+            boundsMin = glm::min(boundsMin, vertexData[i].Position);
+            boundsMax = glm::max(boundsMax, vertexData[i].Position);
+        }
+        boundingCenter = (boundsMin + boundsMax) * 0.5f;
+        for (size_t i = 0; i < numVertices; i++)
+            boundingRadius = std::max(boundingRadius, glm::length(vertexData[i].Position - boundingCenter));
     }
 
-private:
-    // render data 
-    unsigned int VBO, EBO;
+    /**
+     * Keeps the positions of the coarsest level of detail, indexed compactly, as the mesh's collision proxy.
+     */
+    void buildCollisionProxy(const Vertex* vertexData, const unsigned int* indexData) {
+        const MeshLOD& coarsest = lods.back();
+        std::vector<unsigned int> remap(vertexCount, ~0u);
+        collisionVertices.clear();
+        collisionIndices.clear();
+        collisionIndices.reserve(coarsest.indexCount);
+        for (unsigned int i = 0; i < coarsest.indexCount; i++) {
+            unsigned int index = indexData[coarsest.indexOffset + i];
+            if (remap[index] == ~0u) {
+                remap[index] = (unsigned int)collisionVertices.size();
+                collisionVertices.push_back(vertexData[index].Position);
+            }
+            collisionIndices.push_back(remap[index]);
+        }
+        collisionVertices.shrink_to_fit();
+    }
 
     /**
      * Method that initializes all the buffer objects/arrays. It set the vertex buffers and its attribute pointers.
+     * Packed meshes fall back to the full format if their texture coordinates don't fit in half floats.
      */
-    void setupMesh() {
+    void setupMesh(const Vertex* vertexData, size_t numVertices, const unsigned int* indexData, size_t numIndices, VertexFormat format) {
+        vertexFormat = format == VERTEX_PACKED && FitsPackedVertex(vertexData, numVertices) ? VERTEX_PACKED : VERTEX_FULL;
+
         // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+        VAO = GLVertexArray::create();
+        VBO = GLBuffer::create();
+        EBO = GLBuffer::create();
 
-        glBindVertexArray(VAO);
+        glBindVertexArray(VAO.get());
         // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+        glBindBuffer(GL_ARRAY_BUFFER, VBO.get());
+        if (vertexFormat == VERTEX_PACKED) {
+            std::vector<PackedVertex> packed(numVertices);
+            for (size_t i = 0; i < numVertices; i++)
+                packed[i] = PackVertex(vertexData[i]);
+            glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof(PackedVertex), packed.data(), GL_STATIC_DRAW);
+        }
+        else
+            glBufferData(GL_ARRAY_BUFFER, numVertices * sizeof(Vertex), vertexData, GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO.get());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof(unsigned int), indexData, GL_STATIC_DRAW);
+        VBO.setMemory(getVertexBytes(), GPU_VERTEX_BUFFER);
+        EBO.setMemory(numIndices * sizeof(unsigned int), GPU_INDEX_BUFFER);
+
+        // set the vertex attribute pointers, as described by the layout of the vertex type
+        if (vertexFormat == VERTEX_PACKED)
+            SetupVertexAttributes<PackedVertex>();
+        else
+            SetupVertexAttributes<Vertex>();
 
         glBindVertexArray(0);
     }
@@ -0,0 +1,227 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "Mesh.h"
+#include "FileCache.h"
+#include "MappedFile.h"
+#include "Trace.h"
+
+/**
+ * On-disk cache of the final per-mesh data produced by Model::loadModel.
+ * A cache file is keyed by the source path, its modification time and size, the Assimp import flags and the
+ * import optimizations done by Model on top of them, and is stored under res/cache/models/. Files are laid out so that vertex and index arrays can be mapped
+ * and uploaded with glBufferData directly, skipping Assimp entirely on a warm start.
+ *
+ * File layout (all offsets from the start of the file, little endian):
+ *   MeshCacheHeader | source path (padded to 8) | MeshCacheEntry[meshCount] | per mesh: texture refs, LOD ranges, vertices, indices
+ */
+class MeshCache {
+public:
+    // bump whenever the layout of the file or of Vertex changes so that stale caches are rebuilt
+    static const uint32_t VERSION = 3;
+
+    /**
+     * Maps the cache file for a source model. Returns false on a cache miss (no file, stale file, or corrupt file).
+     */
+    bool open(const std::string& sourcePath, unsigned int importFlags, unsigned int optimizations) {
+        TRACE_SCOPE("io", "MeshCache::open", sourcePath);
+        file.close();
+        meshes.clear();
+        SourceFileStamp source = FileCache::stamp(sourcePath);
+        if (!source.exists || !file.open(cachePath(sourcePath, importFlags, optimizations)))
+            return false;
+        if (!parse(sourcePath, importFlags, optimizations, source)) {
+            file.close();
+            meshes.clear();
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Gets the meshes of the currently open cache file.
+     */
+    const std::vector<MeshView>& getMeshes() const {
+        return meshes;
+    }
+
+    /**
+     * Writes (or replaces) the cache file for a source model from its processed meshes. Returns false on failure.
+     */
+    static bool write(const std::string& sourcePath, unsigned int importFlags, unsigned int optimizations, const std::vector<MeshView>& meshes) {
+        TRACE_SCOPE("io", "MeshCache::write", sourcePath);
+        SourceFileStamp source = FileCache::stamp(sourcePath);
+        if (!source.exists)
+            return false;
+
+        // first pass: compute the layout of the file
+        std::vector<MeshCacheEntry> entries(meshes.size());
+        size_t offset = sizeof(MeshCacheHeader) + FileCache::align(sourcePath.size(), 8);
+        offset += entries.size() * sizeof(MeshCacheEntry);
+        for (size_t i = 0; i < meshes.size(); i++) {
+            const MeshView& mesh = meshes[i];
+            MeshCacheEntry& entry = entries[i];
+            entry.textureOffset = offset;
+            entry.textureCount = (uint32_t)mesh.textures.size();
+            for (const TextureRef& texture : mesh.textures)
+                offset += FileCache::align(2 * sizeof(uint32_t) + texture.type.size() + texture.path.size(), 4);
+            entry.lodCount = (uint32_t)mesh.lods.size();
+            offset += mesh.lods.size() * sizeof(MeshCacheLOD);
+            offset = FileCache::align(offset, 16);
+            entry.vertexOffset = offset;
+            entry.vertexCount = mesh.numVertices;
+            offset = FileCache::align(offset + mesh.numVertices * sizeof(Vertex), 16);
+            entry.indexOffset = offset;
+            entry.indexCount = mesh.numIndices;
+            offset = FileCache::align(offset + mesh.numIndices * sizeof(unsigned int), 16);
+        }
+
+        // second pass: fill in the data
+        std::vector<char> data(offset, 0);
+        MeshCacheHeader header;
+        std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+        header.version = VERSION;
+        header.sourceModifiedTime = source.modifiedTime;
+        header.sourceSize = source.size;
+        header.importFlags = importFlags;
+        header.optimizations = optimizations;
+        header.meshCount = (uint32_t)meshes.size();
+        header.sourcePathLength = (uint32_t)sourcePath.size();
+        std::memcpy(&data[0], &header, sizeof(header));
+        std::memcpy(&data[sizeof(header)], sourcePath.data(), sourcePath.size());
+        size_t entriesOffset = sizeof(MeshCacheHeader) + FileCache::align(sourcePath.size(), 8);
+        if (!entries.empty())
+            std::memcpy(&data[entriesOffset], entries.data(), entries.size() * sizeof(MeshCacheEntry));
+        for (size_t i = 0; i < meshes.size(); i++) {
+            const MeshView& mesh = meshes[i];
+            const MeshCacheEntry& entry = entries[i];
+            size_t textureOffset = (size_t)entry.textureOffset;
+            for (const TextureRef& texture : mesh.textures) {
+                uint32_t lengths[2] = { (uint32_t)texture.type.size(), (uint32_t)texture.path.size() };
+                std::memcpy(&data[textureOffset], lengths, sizeof(lengths));
+                std::memcpy(&data[textureOffset + sizeof(lengths)], texture.type.data(), texture.type.size());
+                std::memcpy(&data[textureOffset + sizeof(lengths) + texture.type.size()], texture.path.data(), texture.path.size());
+                textureOffset += FileCache::align(sizeof(lengths) + texture.type.size() + texture.path.size(), 4);
+            }
+            for (const MeshLOD& lod : mesh.lods) {
+                MeshCacheLOD cached = { lod.indexOffset, lod.indexCount, lod.error };
+                std::memcpy(&data[textureOffset], &cached, sizeof(cached));
+                textureOffset += sizeof(cached);
+            }
+            if (mesh.numVertices)
+                std::memcpy(&data[(size_t)entry.vertexOffset], mesh.vertices, mesh.numVertices * sizeof(Vertex));
+            if (mesh.numIndices)
+                std::memcpy(&data[(size_t)entry.indexOffset], mesh.indices, mesh.numIndices * sizeof(unsigned int));
+        }
+        return FileCache::writeFile(cachePath(sourcePath, importFlags, optimizations), data);
+    }
+
+private:
+    static constexpr const char* MAGIC = "FSMC";
+
+    struct MeshCacheHeader {
+        char     magic[4];
+        uint32_t version;
+        uint64_t sourceModifiedTime;
+        uint64_t sourceSize;
+        uint32_t importFlags;
+        uint32_t meshCount;
+        uint32_t sourcePathLength;
+        uint32_t optimizations;
+    };
+
+    struct MeshCacheEntry {
+        uint64_t textureOffset = 0;
+        uint64_t vertexOffset = 0;
+        uint64_t indexOffset = 0;
+        uint32_t textureCount = 0;
+        uint32_t vertexCount = 0;
+        uint32_t indexCount = 0;
+        uint32_t lodCount = 0;
+    };
+
+    struct MeshCacheLOD {
+        uint32_t indexOffset;
+        uint32_t indexCount;
+        float    error;
+    };
+
+    MappedFile file;
+    std::vector<MeshView> meshes;
+
+    // the flags are part of the name, so models loaded with different options keep separate files
+    static std::string cachePath(const std::string& sourcePath, uint32_t importFlags, uint32_t optimizations) {
+        uint64_t key = FileCache::hash(sourcePath);
+        key = FileCache::hash(&importFlags, sizeof(importFlags), key);
+        key = FileCache::hash(&optimizations, sizeof(optimizations), key);
+        return FileCache::cacheFilePath("models", key, ".mcache");
+    }
+
+    /**
+     * Validates the mapped file against the source model and builds the mesh views. Every offset is bounds checked,
+     * since the cache directory may contain files written by an older or interrupted run.
+     */
+    bool parse(const std::string& sourcePath, unsigned int importFlags, unsigned int optimizations, const SourceFileStamp& source) {
+        const unsigned char* base = file.data();
+        size_t size = file.size();
+        if (size < sizeof(MeshCacheHeader))
+            return false;
+        MeshCacheHeader header;
+        std::memcpy(&header, base, sizeof(header));
+        if (std::memcmp(header.magic, MAGIC, sizeof(header.magic)) != 0 || header.version != VERSION ||
+            header.importFlags != importFlags || header.optimizations != optimizations || header.sourceModifiedTime != source.modifiedTime ||
+            header.sourceSize != source.size || header.sourcePathLength != sourcePath.size())
+            return false;
+        if (size < sizeof(header) + sourcePath.size() ||
+            std::memcmp(base + sizeof(header), sourcePath.data(), sourcePath.size()) != 0)
+            return false;
+
+        size_t entriesOffset = sizeof(MeshCacheHeader) + FileCache::align(sourcePath.size(), 8);
+        if (entriesOffset + (size_t)header.meshCount * sizeof(MeshCacheEntry) > size)
+            return false;
+        for (uint32_t i = 0; i < header.meshCount; i++) {
+            MeshCacheEntry entry;
+            std::memcpy(&entry, base + entriesOffset + i * sizeof(MeshCacheEntry), sizeof(entry));
+            if (entry.vertexOffset + (uint64_t)entry.vertexCount * sizeof(Vertex) > size ||
+                entry.indexOffset + (uint64_t)entry.indexCount * sizeof(unsigned int) > size)
+                return false;
+            MeshView mesh;
+            mesh.vertices = reinterpret_cast<const Vertex*>(base + entry.vertexOffset);
+            mesh.numVertices = entry.vertexCount;
+            mesh.indices = reinterpret_cast<const unsigned int*>(base + entry.indexOffset);
+            mesh.numIndices = entry.indexCount;
+            size_t textureOffset = (size_t)entry.textureOffset;
+            for (uint32_t t = 0; t < entry.textureCount; t++) {
+                uint32_t lengths[2];
+                if (textureOffset + sizeof(lengths) > size)
+                    return false;
+                std::memcpy(lengths, base + textureOffset, sizeof(lengths));
+                if (textureOffset + sizeof(lengths) + (size_t)lengths[0] + lengths[1] > size)
+                    return false;
+                const char* chars = reinterpret_cast<const char*>(base + textureOffset + sizeof(lengths));
+                TextureRef ref;
+                ref.type.assign(chars, lengths[0]);
+                ref.path.assign(chars + lengths[0], lengths[1]);
+                mesh.textures.push_back(ref);
+                textureOffset += FileCache::align(sizeof(lengths) + lengths[0] + lengths[1], 4);
+            }
+            if (textureOffset + (size_t)entry.lodCount * sizeof(MeshCacheLOD) > size)
+                return false;
+            for (uint32_t l = 0; l < entry.lodCount; l++) {
+                MeshCacheLOD cached;
+                std::memcpy(&cached, base + textureOffset + l * sizeof(MeshCacheLOD), sizeof(cached));
+                if ((uint64_t)cached.indexOffset + cached.indexCount > entry.indexCount)
+                    return false;
+                MeshLOD lod;
+                lod.indexOffset = cached.indexOffset;
+                lod.indexCount = cached.indexCount;
+                lod.error = cached.error;
+                mesh.lods.push_back(lod);
+            }
+            meshes.push_back(mesh);
+        }
+        return true;
+    }
+};
@@ -0,0 +1,310 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "VertexLayout.h"
+
+/**
+ * Post-transform vertex cache statistics of an index buffer, simulated with a FIFO cache.
+ * ACMR is the average number of vertices transformed per triangle (0.5 is ideal for large regular meshes, 3 is worst),
+ * ATVR the average number of times each vertex is transformed (1 is ideal).
+ */
+struct VertexCacheStats {
+    unsigned int triangles = 0;
+    unsigned int vertices = 0;  // distinct vertices referenced by the indices
+    unsigned int transforms = 0; // cache misses, i.e. vertex shader invocations
+
+    float getACMR() const {
+        return triangles ? (float)transforms / triangles : 0.0f;
+    }
+
+    float getATVR() const {
+        return vertices ? (float)transforms / vertices : 0.0f;
+    }
+
+    void add(const VertexCacheStats& other) {
+        triangles += other.triangles;
+        vertices += other.vertices;
+        transforms += other.transforms;
+    }
+};
+
+/**
+ * Reorders the triangles and vertices of indexed triangle meshes to reduce the work the GPU does to draw them:
+ *  1. optimizeVertexCache: triangle order for post-transform cache reuse (Tipsify, Sander et al. 2007)
+ *  2. optimizeOverdraw: order of the resulting triangle clusters, so that outward facing clusters (the likely occluders)
+ *     are drawn first, without giving up more than a bit of the cache reuse
+ *  3. optimizeVertexFetch: vertex order matching the first use by the indices, for pre-transform fetch locality
+ * Each step keeps the set of triangles and their winding, so the mesh looks exactly the same.
+ */
+class MeshOptimizer {
+public:
+    // FIFO cache size used for optimizing and for the statistics; small enough to be pessimistic on current GPUs
+    static const unsigned int CACHE_SIZE = 16;
+    // the overdraw pass may make the ACMR of a triangle cluster at most this much worse
+    static constexpr float OVERDRAW_THRESHOLD = 1.05f;
+
+    /**
+     * Simulates the post-transform vertex cache for an index buffer.
+     */
+    static VertexCacheStats analyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = CACHE_SIZE) {
+        VertexCacheStats stats;
+        stats.triangles = (unsigned int)(indices.size() / 3);
+        std::vector<unsigned int> cacheTime(vertexCount, 0);
+        std::vector<bool> referenced(vertexCount, false);
+        unsigned int time = cacheSize + 1;
+        for (unsigned int index : indices) {
+            if (!referenced[index]) {
+                referenced[index] = true;
+                stats.vertices++;
+            }
+            if (time - cacheTime[index] > cacheSize) {
+                cacheTime[index] = time++;
+                stats.transforms++;
+            }
+        }
+        return stats;
+    }
+
+    /**
+     * Reorders triangles for post-transform vertex cache reuse with Tipsify: triangles are emitted as fans around
+     * a vertex, choosing the next fanning vertex among the ones just emitted that will still be in the cache.
+     * Runs in linear time.
+     */
+    static void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = CACHE_SIZE) {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+            return;
+
+        // triangles adjacent to each vertex, as offsets into one array
+        std::vector<unsigned int> liveTriangles(vertexCount, 0);
+        for (unsigned int index : indices)
+            liveTriangles[index]++;
+        std::vector<unsigned int> adjacencyOffsets(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++)
+            adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+        std::vector<unsigned int> adjacency(indices.size());
+        std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+            adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+
+        std::vector<unsigned int> cacheTime(vertexCount, 0);
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<unsigned int> deadEnds; // recently used vertices, to restart from when a fan runs out
+        std::vector<unsigned int> candidates;
+        std::vector<unsigned int> result;
+        result.reserve(indices.size());
+        unsigned int time = cacheSize + 1;
+        size_t cursor = 0; // next vertex to check for live triangles when there are no dead ends left
+
+        int fanning = nextLiveVertex(liveTriangles, deadEnds, cursor);
+        while (fanning >= 0) {
+            candidates.clear();
+            for (unsigned int a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; a++) {
+                unsigned int triangle = adjacency[a];
+                if (emitted[triangle])
+                    continue;
+                emitted[triangle] = true;
+                for (unsigned int corner = 0; corner < 3; corner++) {
+                    unsigned int v = indices[triangle * 3 + corner];
+                    result.push_back(v);
+                    deadEnds.push_back(v);
+                    candidates.push_back(v);
+                    liveTriangles[v]--;
+                    if (time - cacheTime[v] > cacheSize)
+                        cacheTime[v] = time++;
+                }
+            }
+
+            // prefer the candidate with live triangles that entered the cache earliest but will survive its whole fan
+            fanning = -1;
+            int best = -1;
+            for (unsigned int v : candidates) {
+                if (liveTriangles[v] == 0)
+                    continue;
+                int priority = 0;
+                if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+                    priority = (int)(time - cacheTime[v]);
+                if (priority > best) {
+                    best = priority;
+                    fanning = (int)v;
+                }
+            }
+            if (fanning < 0)
+                fanning = nextLiveVertex(liveTriangles, deadEnds, cursor);
+        }
+        indices.swap(result);
+    }
+
+    /**
+     * Reorders the triangle clusters of a cache optimized index buffer from the outside of the mesh in, so that
+     * depth testing rejects more fragments (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw").
+     * Clusters start where the cache has to be refilled anyway, and are split further as long as each piece keeps
+     * its ACMR within threshold times the one of the whole cluster.
+     */
+    static void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices,
+                                 float threshold = OVERDRAW_THRESHOLD, unsigned int cacheSize = CACHE_SIZE) {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount < 2)
+            return;
+
+        std::vector<unsigned int> clusters = findClusters(indices, vertices.size(), threshold, cacheSize);
+        if (clusters.size() < 2)
+            return;
+
+        // area weighted centroids and normals of the mesh and of each cluster
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0.0f;
+        std::vector<glm::vec3> centroids(clusters.size(), glm::vec3(0.0f));
+        std::vector<glm::vec3> normals(clusters.size(), glm::vec3(0.0f));
+        std::vector<float> areas(clusters.size(), 0.0f);
+        for (size_t c = 0; c < clusters.size(); c++) {
+            size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+            for (size_t t = clusters[c]; t < end; t++) {
+                const glm::vec3& p0 = vertices[indices[t * 3 + 0]].Position;
+                const glm::vec3& p1 = vertices[indices[t * 3 + 1]].Position;
+                const glm::vec3& p2 = vertices[indices[t * 3 + 2]].Position;
+                glm::vec3 normal = glm::cross(p1 - p0, p2 - p0); // length is twice the area
+                float area = glm::length(normal);
+                centroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+                normals[c] += normal;
+                areas[c] += area;
+            }
+            meshCentroid += centroids[c];
+            meshArea += areas[c];
+        }
+        if (meshArea <= 0.0f)
+            return;
+        meshCentroid /= meshArea;
+
+        // clusters facing away from the mesh center, and far from it, are drawn first
+        std::vector<float> sortKeys(clusters.size(), 0.0f);
+        for (size_t c = 0; c < clusters.size(); c++) {
+            if (areas[c] <= 0.0f)
+                continue;
+            glm::vec3 centroid = centroids[c] / areas[c];
+            float length = glm::length(normals[c]);
+            glm::vec3 normal = length > 0.0f ? normals[c] / length : glm::vec3(0.0f);
+            sortKeys[c] = glm::dot(centroid - meshCentroid, normal);
+        }
+        std::vector<size_t> order(clusters.size());
+        for (size_t c = 0; c < order.size(); c++)
+            order[c] = c;
+        std::stable_sort(order.begin(), order.end(), [&sortKeys](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+        std::vector<unsigned int> result;
+        result.reserve(indices.size());
+        for (size_t c : order) {
+            size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+            result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + end * 3);
+        }
+        indices.swap(result);
+    }
+
+    /**
+     * Reorders vertices in the order the indices first reference them, and drops unreferenced vertices.
+     */
+    static void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+        const unsigned int UNUSED = ~0u;
+        std::vector<unsigned int> remap(vertices.size(), UNUSED);
+        std::vector<Vertex> result;
+        result.reserve(vertices.size());
+        for (unsigned int& index : indices) {
+            if (remap[index] == UNUSED) {
+                remap[index] = (unsigned int)result.size();
+                result.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        vertices.swap(result);
+    }
+
+    /**
+     * Runs all passes on a mesh.
+     * @param overdraw if false, only the vertex cache and vertex fetch orders are optimized
+     */
+    static void optimize(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, bool overdraw = true) {
+        optimizeVertexCache(indices, vertices.size());
+        if (overdraw)
+            optimizeOverdraw(indices, vertices);
+        optimizeVertexFetch(vertices, indices);
+    }
+
+private:
+    /**
+     * Gets a vertex with live triangles to continue from: the most recently used dead end, or the next one in index order.
+     * Returns -1 once every triangle has been emitted.
+     */
+    static int nextLiveVertex(const std::vector<unsigned int>& liveTriangles, std::vector<unsigned int>& deadEnds, size_t& cursor) {
+        while (!deadEnds.empty()) {
+            unsigned int v = deadEnds.back();
+            deadEnds.pop_back();
+            if (liveTriangles[v] > 0)
+                return (int)v;
+        }
+        for (; cursor < liveTriangles.size(); cursor++)
+            if (liveTriangles[cursor] > 0)
+                return (int)cursor;
+        return -1;
+    }
+
+    /**
+     * Splits the triangles into clusters that can be drawn in any order for about the same cache reuse.
+     * Returns the first triangle of each cluster.
+     */
+    static std::vector<unsigned int> findClusters(const std::vector<unsigned int>& indices, size_t vertexCount,
+                                                  float threshold, unsigned int cacheSize) {
+        size_t triangleCount = indices.size() / 3;
+        std::vector<unsigned int> cacheTime(vertexCount, 0);
+        unsigned int time = cacheSize + 1;
+        auto transformTriangle = [&](size_t t) {
+            unsigned int misses = 0;
+            for (unsigned int corner = 0; corner < 3; corner++) {
+                unsigned int v = indices[t * 3 + corner];
+                if (time - cacheTime[v] > cacheSize) {
+                    cacheTime[v] = time++;
+                    misses++;
+                }
+            }
+            return misses;
+        };
+        auto resetCache = [&]() {
+            time += cacheSize + 1;
+        };
+
+        // hard boundaries: triangles where all three vertices miss the cache
+        std::vector<unsigned int> hard;
+        for (size_t t = 0; t < triangleCount; t++)
+            if (transformTriangle(t) == 3)
+                hard.push_back((unsigned int)t);
+        if (hard.empty() || hard[0] != 0)
+            hard.insert(hard.begin(), 0);
+
+        // soft boundaries: split a cluster as soon as the part so far is about as cache efficient as the whole cluster
+        std::vector<unsigned int> clusters;
+        for (size_t h = 0; h < hard.size(); h++) {
+            size_t start = hard[h];
+            size_t end = h + 1 < hard.size() ? hard[h + 1] : triangleCount;
+            resetCache();
+            unsigned int clusterMisses = 0;
+            for (size_t t = start; t < end; t++)
+                clusterMisses += transformTriangle(t);
+            float clusterThreshold = threshold * clusterMisses / (float)(end - start);
+
+            resetCache();
+            clusters.push_back((unsigned int)start);
+            unsigned int misses = 0, triangles = 0;
+            for (size_t t = start; t < end; t++) {
+                misses += transformTriangle(t);
+                triangles++;
+                if (t + 1 < end && misses <= clusterThreshold * triangles) {
+                    clusters.push_back((unsigned int)(t + 1));
+                    resetCache();
+                    misses = 0;
+                    triangles = 0;
+                }
+            }
+        }
+        return clusters;
+    }
+};
@@ -0,0 +1,334 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+#include <glm/glm.hpp>
+#include "VertexLayout.h"
+
+/**
+ * Reduces the triangle count of indexed meshes by collapsing edges in order of their quadric error
+ * (Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics").
+ * Vertices are only ever collapsed onto other existing vertices, so a simplified index buffer can be drawn with the
+ * vertex buffer of the original mesh; all levels of detail of a mesh share one vertex buffer.
+ *
+ * Vertices on attribute seams (several vertices at the same position, e.g. with different texture coordinates) and on
+ * non-manifold or complex borders never move, which keeps textures and silhouettes from tearing. Border vertices may
+ * only slide along their border.
+ */
+class MeshSimplifier {
+public:
+    // extra weight of the planes that keep open borders in place, relative to the triangle planes
+    static constexpr float BORDER_WEIGHT = 10.0f;
+
+    /**
+     * Gets the radius of a bounding sphere of the vertices, centered on their bounding box. Errors are relative to it.
+     */
+    static float getRadius(const std::vector<Vertex>& vertices) {
+        if (vertices.empty())
+            return 0.0f;
+        glm::vec3 min = vertices[0].Position, max = vertices[0].Position;
+        for (const Vertex& vertex : vertices) {
+            min = glm::min(min, vertex.Position);
+            max = glm::max(max, vertex.Position);
+        }
+        glm::vec3 center = (min + max) * 0.5f;
+        float radius = 0.0f;
+        for (const Vertex& vertex : vertices)
+            radius = std::max(radius, glm::length(vertex.Position - center));
+        return radius;
+    }
+
+    /**
+     * Simplifies a triangle list until it has at most targetIndexCount indices, or until the next collapse would move
+     * the surface further than targetError. Returns the simplified indices, referencing the same vertices.
+     * @param targetError maximum error, as a fraction of the mesh's radius (see getRadius)
+     * @param resultError if set, receives the error of the result in the same unit
+     */
+    static std::vector<unsigned int> simplify(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+                                              size_t targetIndexCount, float targetError, float* resultError = nullptr) {
+        std::vector<unsigned int> result(indices);
+        float maxError = 0.0f;
+        float radius = getRadius(vertices);
+        if (radius <= 0.0f || result.size() <= targetIndexCount) {
+            if (resultError)
+                *resultError = 0.0f;
+            return result;
+        }
+        double errorLimit = (double)targetError * radius * targetError * radius;
+
+        // vertices sharing a position are one vertex for the topology and the quadrics
+        std::vector<unsigned int> remap = buildPositionRemap(vertices);
+        std::vector<unsigned int> wedgeCount(vertices.size(), 0);
+        for (size_t v = 0; v < vertices.size(); v++)
+            wedgeCount[remap[v]]++;
+
+        std::vector<Quadric> quadrics = buildQuadrics(vertices, remap, result);
+
+        std::vector<unsigned char> kinds;
+        EdgeMap edges;
+        std::vector<Collapse> candidates;
+        std::vector<unsigned int> collapseTo(vertices.size());
+        std::vector<bool> locked(vertices.size());
+        std::vector<unsigned int> triangleOffsets, triangles;
+
+        while (result.size() > targetIndexCount) {
+            classifyVertices(remap, wedgeCount, result, edges, kinds);
+            buildVertexTriangles(remap, result, triangleOffsets, triangles);
+
+            // every allowed collapse of every edge, cheapest first
+            candidates.clear();
+            for (size_t i = 0; i < result.size(); i += 3) {
+                for (unsigned int e = 0; e < 3; e++) {
+                    unsigned int v0 = result[i + e], v1 = result[i + (e + 1) % 3];
+                    addCandidate(vertices, remap, quadrics, kinds, edges, v0, v1, candidates);
+                    addCandidate(vertices, remap, quadrics, kinds, edges, v1, v0, candidates);
+                }
+            }
+            std::sort(candidates.begin(), candidates.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+            // do as many collapses as possible without two of them touching the same triangles
+            for (size_t v = 0; v < collapseTo.size(); v++)
+                collapseTo[v] = (unsigned int)v;
+            std::fill(locked.begin(), locked.end(), false);
+            size_t triangleCount = result.size() / 3;
+            size_t targetTriangles = targetIndexCount / 3;
+            size_t collapses = 0;
+            for (const Collapse& collapse : candidates) {
+                if (collapse.error > errorLimit || triangleCount <= targetTriangles)
+                    break;
+                unsigned int p0 = remap[collapse.from], p1 = remap[collapse.to];
+                if (locked[p0] || locked[p1])
+                    continue;
+                if (flipsTriangles(vertices, remap, result, triangleOffsets, triangles, p0, vertices[collapse.to].Position))
+                    continue;
+                collapseTo[collapse.from] = collapse.to;
+                quadrics[p1].add(quadrics[p0]);
+                // lock the whole neighborhood, so the flip test of later collapses in this pass sees the final positions
+                for (unsigned int t = triangleOffsets[p0]; t < triangleOffsets[p0 + 1]; t++)
+                    for (unsigned int corner = 0; corner < 3; corner++)
+                        locked[remap[result[triangles[t] * 3 + corner]]] = true;
+                triangleCount -= kinds[p0] == VERTEX_KIND_BORDER ? 1 : 2;
+                maxError = std::max(maxError, (float)std::sqrt(std::max(collapse.error, 0.0)));
+                collapses++;
+            }
+            if (collapses == 0)
+                break;
+
+            // apply the collapses and drop the triangles that became degenerate
+            size_t write = 0;
+            for (size_t i = 0; i < result.size(); i += 3) {
+                unsigned int a = collapseTo[result[i]], b = collapseTo[result[i + 1]], c = collapseTo[result[i + 2]];
+                if (remap[a] == remap[b] || remap[b] == remap[c] || remap[c] == remap[a])
+                    continue;
+                result[write++] = a;
+                result[write++] = b;
+                result[write++] = c;
+            }
+            result.resize(write);
+        }
+
+        if (resultError)
+            *resultError = maxError / radius;
+        return result;
+    }
+
+private:
+    enum VertexKind : unsigned char {
+        VERTEX_KIND_MANIFOLD, // interior vertex, may collapse onto any neighbor
+        VERTEX_KIND_BORDER,   // on exactly one open border, may only collapse along it
+        VERTEX_KIND_LOCKED    // seam, complex border or unreferenced; never moves
+    };
+
+    /**
+     * Symmetric 4x4 matrix of a sum of squared plane distances, plus the total weight of the planes.
+     */
+    struct Quadric {
+        double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+        double b0 = 0, b1 = 0, b2 = 0, c = 0;
+        double weight = 0;
+
+        static Quadric fromPlane(const glm::vec3& normal, float distance, float weight) {
+            Quadric q;
+            double a = normal.x, b = normal.y, cc = normal.z, d = distance;
+            q.a00 = a * a * weight; q.a01 = a * b * weight; q.a02 = a * cc * weight;
+            q.a11 = b * b * weight; q.a12 = b * cc * weight; q.a22 = cc * cc * weight;
+            q.b0 = a * d * weight; q.b1 = b * d * weight; q.b2 = cc * d * weight;
+            q.c = d * d * weight;
+            q.weight = weight;
+            return q;
+        }
+
+        void add(const Quadric& q) {
+            a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+            b0 += q.b0; b1 += q.b1; b2 += q.b2; c += q.c;
+            weight += q.weight;
+        }
+
+        // weighted mean squared distance of a point to the planes
+        double error(const glm::vec3& p) const {
+            double x = p.x, y = p.y, z = p.z;
+            double e = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + a11 * y * y + 2 * a12 * y * z + a22 * z * z
+                     + 2 * (b0 * x + b1 * y + b2 * z) + c;
+            return weight > 0 ? std::abs(e) / weight : 0.0;
+        }
+    };
+
+    struct Collapse {
+        unsigned int from, to; // vertex indices
+        double error;
+    };
+
+    // number of directed edges between two position indices
+    typedef std::unordered_map<uint64_t, unsigned int> EdgeMap;
+
+    static uint64_t edgeKey(unsigned int from, unsigned int to) {
+        return ((uint64_t)from << 32) | to;
+    }
+
+    static std::vector<unsigned int> buildPositionRemap(const std::vector<Vertex>& vertices) {
+        struct PositionHash {
+            size_t operator()(const glm::vec3& p) const {
+                uint32_t bits[3];
+                std::memcpy(bits, &p, sizeof(bits));
+                return (size_t)(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+            }
+        };
+        std::unordered_map<glm::vec3, unsigned int, PositionHash> first;
+        first.reserve(vertices.size());
+        std::vector<unsigned int> remap(vertices.size());
+        for (size_t v = 0; v < vertices.size(); v++)
+            remap[v] = first.emplace(vertices[v].Position, (unsigned int)v).first->second;
+        return remap;
+    }
+
+    static std::vector<Quadric> buildQuadrics(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& remap,
+                                              const std::vector<unsigned int>& indices) {
+        std::vector<Quadric> quadrics(vertices.size());
+        EdgeMap edges;
+        for (size_t i = 0; i < indices.size(); i += 3)
+            for (unsigned int e = 0; e < 3; e++)
+                edges[edgeKey(remap[indices[i + e]], remap[indices[i + (e + 1) % 3]])]++;
+
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            unsigned int p[3] = { remap[indices[i]], remap[indices[i + 1]], remap[indices[i + 2]] };
+            glm::vec3 v0 = vertices[p[0]].Position, v1 = vertices[p[1]].Position, v2 = vertices[p[2]].Position;
+            glm::vec3 normal = glm::cross(v1 - v0, v2 - v0);
+            float area = glm::length(normal);
+            if (area <= 0.0f)
+                continue;
+            normal /= area;
+            Quadric plane = Quadric::fromPlane(normal, -glm::dot(normal, v0), area);
+            for (unsigned int corner = 0; corner < 3; corner++)
+                quadrics[p[corner]].add(plane);
+
+            // open edges get a plane through them, perpendicular to the triangle, so collapses don't eat into the border
+            for (unsigned int e = 0; e < 3; e++) {
+                unsigned int a = p[e], b = p[(e + 1) % 3];
+                if (edges.count(edgeKey(b, a)))
+                    continue;
+                glm::vec3 edge = vertices[b].Position - vertices[a].Position;
+                float length = glm::length(edge);
+                if (length <= 0.0f)
+                    continue;
+                glm::vec3 edgeNormal = glm::normalize(glm::cross(edge, normal));
+                Quadric border = Quadric::fromPlane(edgeNormal, -glm::dot(edgeNormal, vertices[a].Position), length * length * BORDER_WEIGHT);
+                quadrics[a].add(border);
+                quadrics[b].add(border);
+            }
+        }
+        return quadrics;
+    }
+
+    static void classifyVertices(const std::vector<unsigned int>& remap, const std::vector<unsigned int>& wedgeCount,
+                                 const std::vector<unsigned int>& indices, EdgeMap& edges, std::vector<unsigned char>& kinds) {
+        edges.clear();
+        for (size_t i = 0; i < indices.size(); i += 3)
+            for (unsigned int e = 0; e < 3; e++)
+                edges[edgeKey(remap[indices[i + e]], remap[indices[i + (e + 1) % 3]])]++;
+
+        std::vector<unsigned int> borderOut(remap.size(), 0), borderIn(remap.size(), 0), used(remap.size(), 0);
+        for (const auto& edge : edges) {
+            unsigned int from = (unsigned int)(edge.first >> 32), to = (unsigned int)edge.first;
+            used[from]++;
+            if (edge.second > 1)
+                borderOut[from] += 2; // the same directed edge twice is non-manifold
+            else if (!edges.count(edgeKey(to, from))) {
+                borderOut[from]++;
+                borderIn[to]++;
+            }
+        }
+        kinds.assign(remap.size(), VERTEX_KIND_LOCKED);
+        for (size_t p = 0; p < remap.size(); p++) {
+            if (remap[p] != p || !used[p] || wedgeCount[p] > 1)
+                continue;
+            if (borderOut[p] == 0 && borderIn[p] == 0)
+                kinds[p] = VERTEX_KIND_MANIFOLD;
+            else if (borderOut[p] == 1 && borderIn[p] == 1)
+                kinds[p] = VERTEX_KIND_BORDER;
+        }
+    }
+
+    // triangles around each position, as offsets into one array
+    static void buildVertexTriangles(const std::vector<unsigned int>& remap, const std::vector<unsigned int>& indices,
+                                     std::vector<unsigned int>& offsets, std::vector<unsigned int>& triangles) {
+        offsets.assign(remap.size() + 1, 0);
+        for (unsigned int index : indices)
+            offsets[remap[index] + 1]++;
+        for (size_t p = 0; p < remap.size(); p++)
+            offsets[p + 1] += offsets[p];
+        triangles.resize(indices.size());
+        std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+            triangles[fill[remap[indices[i]]]++] = (unsigned int)(i / 3);
+    }
+
+    static void addCandidate(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& remap, const std::vector<Quadric>& quadrics,
+                             const std::vector<unsigned char>& kinds, const EdgeMap& edges, unsigned int from, unsigned int to,
+                             std::vector<Collapse>& candidates) {
+        unsigned int p0 = remap[from], p1 = remap[to];
+        if (p0 == p1 || kinds[p0] == VERTEX_KIND_LOCKED)
+            return;
+        if (kinds[p0] == VERTEX_KIND_BORDER) {
+            // only along the border: exactly one direction of the edge exists
+            bool forward = edges.count(edgeKey(p0, p1)) != 0, backward = edges.count(edgeKey(p1, p0)) != 0;
+            if (forward == backward)
+                return;
+        }
+        Quadric q = quadrics[p0];
+        q.add(quadrics[p1]);
+        Collapse collapse;
+        collapse.from = from;
+        collapse.to = to;
+        collapse.error = q.error(vertices[to].Position);
+        candidates.push_back(collapse);
+    }
+
+    // checks if moving a position would turn any of its remaining triangles over
+    static bool flipsTriangles(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& remap, const std::vector<unsigned int>& indices,
+                               const std::vector<unsigned int>& offsets, const std::vector<unsigned int>& triangles,
+                               unsigned int moved, const glm::vec3& target) {
+        for (unsigned int t = offsets[moved]; t < offsets[moved + 1]; t++) {
+            unsigned int base = triangles[t] * 3;
+            glm::vec3 before[3], after[3];
+            bool collapses = false;
+            for (unsigned int corner = 0; corner < 3; corner++) {
+                unsigned int p = remap[indices[base + corner]];
+                before[corner] = vertices[p].Position;
+                after[corner] = p == moved ? target : before[corner];
+                if (p != moved && vertices[p].Position == target)
+                    collapses = true;
+            }
+            if (collapses)
+                continue; // the triangle becomes degenerate and is removed
+            glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+            glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+            // rotating a triangle by more than ~75 degrees is as good as flipping it
+            if (glm::dot(normalBefore, normalAfter) < 0.25f * glm::length(normalBefore) * glm::length(normalAfter))
+                return true;
+        }
+        return false;
+    }
+};
@@ -3,19 +3,101 @@
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
-#define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
 #include "Mesh.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
 #include "Shader.h"
+#include "TextureCache.h"
+#include "ObjParser.h"
+#include "StlReader.h"
+#include "Trace.h"
+#include "WorkerPool.h"
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <set>
+#include <unordered_map>
+#include <algorithm>
+#include <cctype>
 #include <vector>
 
-// forward declaration of method that reads a texture from a file
-unsigned int TextureFromFile(const char* path, const std::string& directory, bool gamma = false);
+/**
+ * A mesh imported by Assimp (or the ObjParser), owning its data until it is uploaded.
+ */
+struct ImportedMesh {
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<TextureRef> textures;
+    unsigned int materialIndex = 0; // index of the mesh's material in the Assimp scene or the OBJ file (0 for STL files)
+    std::vector<MeshLOD> lods;      // levels of detail appended to indices, empty if there is only the full mesh
+};
+
+/**
+ * Optimizations done on a model while it is imported by Assimp, combined as bit flags.
+ * The result is stored in the mesh cache, so they cost nothing on a warm start.
+ */
+enum ImportOptimization {
+    IMPORT_WELD_VERTICES              = 1 << 0, // merge identical vertices, so shared corners are stored and shaded once
+    IMPORT_REMOVE_REDUNDANT_MATERIALS = 1 << 1, // merge identical materials and drop unused ones
+    IMPORT_MERGE_MESHES               = 1 << 2, // merge all meshes of the model sharing a material into one, i.e. one draw call per material
+    IMPORT_FLATTEN_GRAPH              = 1 << 3, // collapse the node hierarchy, baking the node transforms into the vertices
+    IMPORT_OPTIMIZE_VERTEX_CACHE      = 1 << 4, // reorder triangles for post-transform cache reuse and vertices for fetch locality
+    IMPORT_OPTIMIZE_OVERDRAW          = 1 << 5, // after the vertex cache pass, draw outward facing triangle clusters first
+    IMPORT_GENERATE_LODS              = 1 << 6, // simplify each mesh into up to Mesh::MAX_LODS levels of detail
+    IMPORT_FAST_OBJ                   = 1 << 7, // read .obj files with the multithreaded ObjParser instead of Assimp
+    IMPORT_FAST_STL                   = 1 << 8, // read binary .stl files with the memory mapped StlFile instead of Assimp
+    // the node transforms are ignored when loading (see processNode), so flattening would move parts of models
+    // whose nodes aren't identity; it is left out of the defaults
+    IMPORT_OPTIMIZE_DEFAULT = IMPORT_WELD_VERTICES | IMPORT_REMOVE_REDUNDANT_MATERIALS | IMPORT_MERGE_MESHES |
+                              IMPORT_OPTIMIZE_VERTEX_CACHE | IMPORT_OPTIMIZE_OVERDRAW | IMPORT_GENERATE_LODS | IMPORT_FAST_OBJ |
+                              IMPORT_FAST_STL
+};
+
+/**
+ * Size of a model's geometry, as drawn: one entry per mesh reference in the node graph.
+ */
+struct ImportStats {
+    unsigned int meshes = 0;
+    unsigned int vertices = 0;
+    unsigned int indices = 0;
+    unsigned int materials = 0;
+};
+
+/**
+ * Settings for how a model file is loaded, chosen by whoever is going to draw it.
+ */
+struct ModelLoadOptions {
+    const Shader* targetShader = nullptr;    // if set, only the textures this shader samples are loaded
+    VertexFormat vertexFormat = VERTEX_FULL; // format the meshes' vertices are uploaded in
+    unsigned int importOptimizations = IMPORT_OPTIMIZE_DEFAULT; // ImportOptimization flags used when importing with Assimp
+    MeshResidency residency = RESIDENCY_KEEP_ALL; // what the meshes keep in system memory after their upload
+};
+
+/**
+ * CPU-side result of loading a model file: everything up to, but excluding, the OpenGL calls.
+ * Filled by Model::importModelData (and TextureCache::prepare for the textures) on any thread, then uploaded
+ * mesh by mesh with Model::uploadMesh on the thread that owns the GL context.
+ */
+struct ModelData {
+    std::string path;
+    std::string directory;
+    bool loadedFromCache = false;
+    MeshCache cache;                             // keeps the mapped cache file alive until the meshes are uploaded
+    std::vector<ImportedMesh> importedMeshes;    // storage for meshes imported by Assimp on a cache miss
+    std::vector<MeshView> meshes;                // meshes to upload, pointing into either the cache or importedMeshes
+    std::map<std::string, TextureHandle> textures; // textures referenced by the meshes, keyed by material path
+    bool filterTextures = false;                 // if true, only texture types in samplerCounts are loaded
+    std::map<std::string, unsigned int> samplerCounts; // number of samplers the target shader reads per texture type
+    size_t skippedTextureBytes = 0;              // estimated GPU memory of the textures left out by the filter
+    VertexFormat vertexFormat = VERTEX_FULL;
+    unsigned int importOptimizations = IMPORT_OPTIMIZE_DEFAULT;
+    MeshResidency residency = RESIDENCY_KEEP_ALL;
+    ImportStats statsBefore, statsAfter;         // geometry before and after the import optimizations, only set on a cache miss
+    VertexCacheStats cacheBefore, cacheAfter;    // vertex cache efficiency before and after reordering, only set on a cache miss
+};
 
 /**
  * Class that encapsulates the data and operations associated with a in-game object including its meshes and textures.
@@ -26,41 +108,254 @@ public:
     // model data 
     std::vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     std::vector<Mesh>    meshes;
+    std::string path;
     std::string directory;
     bool gammaCorrection;
+    bool loadedFromCache = false; // true if the meshes were read from the cooked mesh cache instead of Assimp
+    std::vector<TextureHandle> textureHandles; // texture cache entries of textures_loaded, in the same order
+    size_t skippedTextureBytes = 0; // GPU memory of the textures that weren't loaded because the target shader doesn't sample them
+    glm::vec3 boundingCenter = glm::vec3(0.0f); // bounding sphere of all meshes, in model space
+    float boundingRadius = 0.0f;
+    glm::vec3 boundsMin = glm::vec3(0.0f), boundsMax = glm::vec3(0.0f); // bounding box of all meshes, in model space
+
+    // Assimp post-processing flags used on import. Part of the mesh cache key, so changing them invalidates cached files.
+    static const unsigned int IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
 
     // constructor, expects a filepath to a 3D model.
-    Model(std::string const& path, bool gamma = false) : gammaCorrection(gamma) {
+    Model(std::string const& path, bool gamma = false, const ModelLoadOptions& options = ModelLoadOptions()) : gammaCorrection(gamma) {
         std::cout << "Loading Model " << path << "\n";
-        loadModel(path); 
+        loadModel(path, options);
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader shader) {
+    // constructs an empty model whose meshes are uploaded later with uploadMesh(), see AssetLoader
+    Model() : gammaCorrection(false) {}
+
+    // draws the model, and thus all its meshes, at a level of detail (0 is the full model)
+    void Draw(const Shader& shader, unsigned int lod = 0) {
         for (unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+            meshes[i].Draw(shader, lod);
     }
 
-private:
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(std::string const& path) {
-        // read file via ASSIMP
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-        // check for errors
-        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) { // if is Not Zero
-            std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
-            return;
+    // gets the number of levels of detail of the model, i.e. of its most detailed mesh. Meshes with fewer levels draw their coarsest one.
+    unsigned int getLODCount() const {
+        unsigned int count = 0;
+        for (const Mesh& mesh : meshes)
+            count = std::max(count, mesh.getLODCount());
+        return count;
+    }
+
+    // gets the GPU memory used by the model's vertex and index buffers
+    size_t getGeometryBytes() const {
+        size_t bytes = 0;
+        for (const Mesh& mesh : meshes)
+            bytes += mesh.getVertexBytes() + mesh.indexCount * sizeof(unsigned int);
+        return bytes;
+    }
+
+    // gets the system memory used by the geometry the meshes keep after their upload (see MeshResidency)
+    size_t getCpuBytes() const {
+        size_t bytes = 0;
+        for (const Mesh& mesh : meshes)
+            bytes += mesh.getCpuBytes();
+        return bytes;
+    }
+
+    // gets the system memory the meshes don't use because they released their vertices and indices after the upload
+    size_t getReleasedCpuBytes() const {
+        size_t bytes = 0;
+        for (const Mesh& mesh : meshes)
+            bytes += mesh.getFullCpuBytes() - std::min(mesh.getFullCpuBytes(), mesh.getCpuBytes());
+        return bytes;
+    }
+
+    // gets the GPU memory used by the model's textures, including mipmaps. Streamed textures count once their image is uploaded.
+    size_t getTextureBytes() const {
+        size_t bytes = 0;
+        for (TextureHandle handle : textureHandles)
+            bytes += TextureCache::instance().getGpuBytes(handle);
+        return bytes;
+    }
+
+    // gets the total GPU memory used by the model (geometry and textures)
+    size_t getGpuBytes() const {
+        return getGeometryBytes() + getTextureBytes();
+    }
+
+    /**
+     * Applies load options to model data. Must be called before importModelData.
+     */
+    static void applyOptions(const ModelLoadOptions& options, ModelData& data) {
+        if (options.targetShader)
+            setTargetShader(*options.targetShader, data);
+        data.vertexFormat = options.vertexFormat;
+        data.importOptimizations = options.importOptimizations;
+        data.residency = options.residency;
+    }
+
+    /**
+     * Gets the Assimp post-processing steps doing the provided import optimizations.
+     * Mesh merging isn't one of them; Assimp's aiProcess_OptimizeMeshes only merges meshes of the same node.
+     */
+    static unsigned int getOptimizationFlags(unsigned int optimizations) {
+        unsigned int flags = 0;
+        if (optimizations & IMPORT_WELD_VERTICES)
+            flags |= aiProcess_JoinIdenticalVertices;
+        if (optimizations & IMPORT_REMOVE_REDUNDANT_MATERIALS)
+            flags |= aiProcess_RemoveRedundantMaterials;
+        if (optimizations & IMPORT_FLATTEN_GRAPH)
+            flags |= aiProcess_OptimizeGraph;
+        return flags;
+    }
+
+    /**
+     * Restricts the textures loaded into the model data to the ones the shader samples. Mesh::Draw names the samplers
+     * of each mesh <type>N with N counting up from 1, so a shader reading texture_diffuse1 only needs each mesh's first
+     * diffuse texture. Must be called before importModelData.
+     */
+    static void setTargetShader(const Shader& shader, ModelData& data) {
+        data.filterTextures = true;
+        data.samplerCounts.clear();
+        for (const std::string& name : shader.getSamplerNames()) {
+            size_t digits = name.find_last_not_of("0123456789") + 1;
+            if (digits == name.size())
+                continue; // not one of the numbered material samplers
+            unsigned int number = (unsigned int)std::stoul(name.substr(digits));
+            unsigned int& count = data.samplerCounts[name.substr(0, digits)];
+            count = std::max(count, number);
         }
+    }
+
+    /**
+     * Reads a model file into CPU memory: from the mesh cache if it is up to date, otherwise through the ObjParser
+     * or Assimp (writing a new cache file). Texture paths are collected in data.textures but not decoded yet.
+     * Doesn't make any OpenGL calls, so it is safe to call from a worker thread.
+     */
+    static void importModelData(std::string const& path, ModelData& data) {
+        TRACE_SCOPE("import", "importModelData", path);
+        data.path = path;
         // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
+        data.directory = path.substr(0, path.find_last_of('/'));
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        // warm start: use the cooked meshes if the cache is up to date with the source file
+        unsigned int importFlags = IMPORT_FLAGS | getOptimizationFlags(data.importOptimizations);
+        if (data.cache.open(path, importFlags, data.importOptimizations)) {
+            data.meshes = data.cache.getMeshes();
+            data.loadedFromCache = true;
+        }
+        else {
+            // OBJ and binary STL files are read without Assimp when enabled, falling back to Assimp if that fails
+            bool parsed = ((data.importOptimizations & IMPORT_FAST_OBJ) && hasExtension(path, "obj") && importObj(path, data)) ||
+                          ((data.importOptimizations & IMPORT_FAST_STL) && hasExtension(path, "stl") && importStl(path, data));
+            if (!parsed && !importAssimp(path, data))
+                return;
+
+            if (data.importOptimizations & IMPORT_MERGE_MESHES)
+                mergeMeshes(data.importedMeshes);
+            if (data.importOptimizations & IMPORT_OPTIMIZE_VERTEX_CACHE)
+                reorderMeshes(data);
+            if (data.importOptimizations & IMPORT_GENERATE_LODS)
+                for (ImportedMesh& mesh : data.importedMeshes)
+                    generateLODs(mesh);
+            data.statsAfter.meshes = (unsigned int)data.importedMeshes.size();
+            for (const ImportedMesh& imported : data.importedMeshes) {
+                MeshView view;
+                view.vertices = imported.vertices.data();
+                view.numVertices = (unsigned int)imported.vertices.size();
+                view.indices = imported.indices.data();
+                view.numIndices = (unsigned int)imported.indices.size();
+                view.textures = imported.textures;
+                view.lods = imported.lods;
+                data.meshes.push_back(view);
+                data.statsAfter.vertices += view.numVertices;
+                data.statsAfter.indices += view.lods.empty() ? view.numIndices : view.lods[0].indexCount;
+            }
+            printImportStats(data);
+
+            // cook the processed meshes so the next launch can skip Assimp
+            if (!MeshCache::write(path, importFlags, data.importOptimizations, data.meshes))
+                std::cout << "WARNING::MESH_CACHE:: could not write cache file for " << path << std::endl;
+        }
+
+        if (data.filterTextures)
+            skipUnsampledTextures(data);
+
+        // collect every texture used by the model, each path once
+        for (const MeshView& mesh : data.meshes)
+            for (const TextureRef& ref : mesh.textures)
+                data.textures.emplace(ref.path, INVALID_TEXTURE_HANDLE);
+    }
+
+    /**
+     * Requests all textures collected by importModelData from the texture cache. New images are decoded on the calling
+     * thread, or on the texture streamer's workers when streaming is enabled.
+     */
+    static void prepareTextures(ModelData& data) {
+        for (auto& pair : data.textures)
+            pair.second = TextureCache::instance().request(data.directory, pair.first);
+    }
+
+    /**
+     * Uploads one mesh of imported model data, and any textures it uses that aren't loaded yet, to the GPU.
+     * Must be called on the GL thread. The vertex and index data is uploaded straight from the imported (or mapped) memory.
+     */
+    void uploadMesh(ModelData& data, size_t index) {
+        TRACE_SCOPE("upload", "uploadMesh", data.path);
+        if (index == 0) {
+            path = data.path;
+            directory = data.directory;
+            loadedFromCache = data.loadedFromCache;
+            skippedTextureBytes = data.skippedTextureBytes;
+        }
+        const MeshView& view = data.meshes[index];
+        std::vector<Texture> textures;
+        for (const TextureRef& ref : view.textures)
+            textures.push_back(loadTexture(ref.path.c_str(), ref.type, data));
+        meshes.push_back(Mesh(view.vertices, view.numVertices, view.indices, view.numIndices, textures, data.vertexFormat, view.lods, data.residency));
+        meshes.back().setOwner(data.path);
+        addBoundingSphere(meshes.back().boundingCenter, meshes.back().boundingRadius);
+        addBoundingBox(meshes.back().boundsMin, meshes.back().boundsMax);
+    }
+
+private:
+    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    void loadModel(std::string const& path, const ModelLoadOptions& options) {
+        ModelData data;
+        applyOptions(options, data);
+        importModelData(path, data);
+        prepareTextures(data);
+        for (size_t i = 0; i < data.meshes.size(); i++)
+            uploadMesh(data, i);
+    }
+
+    // removes the texture references no sampler of the target shader would read, and estimates the memory they would have used.
+    // the mesh cache keeps every reference, so the same cache file works for any shader.
+    static void skipUnsampledTextures(ModelData& data) {
+        std::set<std::string> kept, skipped;
+        for (MeshView& mesh : data.meshes) {
+            std::map<std::string, unsigned int> numbers;
+            std::vector<TextureRef> sampled;
+            for (const TextureRef& ref : mesh.textures) {
+                auto count = data.samplerCounts.find(ref.type);
+                if (count != data.samplerCounts.end() && ++numbers[ref.type] <= count->second) {
+                    sampled.push_back(ref);
+                    kept.insert(ref.path);
+                }
+                else
+                    skipped.insert(ref.path);
+            }
+            mesh.textures = sampled;
+        }
+        for (const std::string& path : skipped) {
+            int width, height, components;
+            std::string filename = data.directory + '/' + path;
+            // only reads the image header; counts a full mipmap chain like TextureFromImage
+            if (!kept.count(path) && stbi_info(filename.c_str(), &width, &height, &components))
+                data.skippedTextureBytes += (size_t)width * height * components * 4 / 3;
+        }
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode* node, const aiScene* scene) {
+    static void processNode(aiNode* node, const aiScene* scene, std::vector<ImportedMesh>& meshes) {
         // process each mesh located at the current node
         for (unsigned int i = 0; i < node->mNumMeshes; i++) {
             // the node object only contains indices to index the actual objects in the scene. 
@@ -70,16 +365,119 @@ private:
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for (unsigned int i = 0; i < node->mNumChildren; i++) {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, meshes);
+        }
+
+    }
+
+    // reads a model file with Assimp into data.importedMeshes, measuring it before the optimizations Assimp does
+    static bool importAssimp(std::string const& path, ModelData& data) {
+        TRACE_SCOPE("import", "Assimp import", path);
+        // read file via ASSIMP
+        Assimp::Importer importer;
+        const aiScene* scene = importer.ReadFile(path, IMPORT_FLAGS);
+        // check for errors
+        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) { // if is Not Zero
+            std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+            return false;
+        }
+
+        // the optimizations run as a second pass over the scene, so it can be measured before them
+        data.statsBefore = getImportStats(scene);
+        scene = importer.ApplyPostProcessing(getOptimizationFlags(data.importOptimizations));
+        if (!scene) {
+            std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+            return false;
+        }
+
+        // process ASSIMP's root node recursively
+        processNode(scene->mRootNode, scene, data.importedMeshes);
+        data.statsAfter.materials = scene->mNumMaterials;
+        return true;
+    }
+
+    // checks the extension of a path, ignoring case; extension is lower case and without the dot
+    static bool hasExtension(const std::string& path, const std::string& extension) {
+        size_t dot = path.find_last_of('.');
+        if (dot == std::string::npos)
+            return false;
+        std::string found = path.substr(dot + 1);
+        std::transform(found.begin(), found.end(), found.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        return found == extension;
+    }
+
+    // reads an OBJ file with the ObjParser into data.importedMeshes. Its meshes already have one material each,
+    // and its vertices are welded unless IMPORT_WELD_VERTICES is off. Materials are kept as they are.
+    static bool importObj(std::string const& path, ModelData& data) {
+        ObjParseOptions options;
+        // on an AssetLoader worker the other workers already use the remaining cores
+        if (WorkerPool::isWorkerThread())
+            options.numThreads = 1;
+        options.weldVertices = (data.importOptimizations & IMPORT_WELD_VERTICES) != 0;
+        ObjModel obj;
+        std::string error;
+        if (!ObjParser::parse(path, obj, options, &error)) {
+            std::cout << "WARNING::OBJ_PARSER:: " << error << ", using Assimp instead" << std::endl;
+            return false;
         }
 
+        // what Assimp would have made of the file: a mesh per run of faces, and a vertex per corner
+        data.statsBefore.meshes = obj.numGroups;
+        data.statsBefore.vertices = obj.numCorners;
+        data.statsBefore.indices = obj.numCorners;
+        data.statsBefore.materials = (unsigned int)obj.materials.size();
+        data.statsAfter.materials = (unsigned int)obj.materials.size();
+        for (ObjMesh& mesh : obj.meshes) {
+            ImportedMesh imported;
+            imported.vertices = std::move(mesh.vertices);
+            imported.indices = std::move(mesh.indices);
+            imported.materialIndex = mesh.materialIndex;
+            // the same texture types Assimp maps the MTL statements to, see processMesh
+            const ObjMaterial& material = obj.materials[mesh.materialIndex];
+            addTextureRefs(material.diffuseMaps, "texture_diffuse", imported.textures);
+            addTextureRefs(material.specularMaps, "texture_specular", imported.textures);
+            addTextureRefs(material.bumpMaps, "texture_normal", imported.textures);
+            addTextureRefs(material.ambientMaps, "texture_height", imported.textures);
+            data.importedMeshes.push_back(std::move(imported));
+        }
+        return true;
+    }
+
+    // reads a binary STL file into a single untextured mesh, welding its corners unless IMPORT_WELD_VERTICES is off.
+    // ASCII STL files are left to Assimp
+    static bool importStl(std::string const& path, ModelData& data) {
+        TRACE_SCOPE("import", "STL import", path);
+        ImportedMesh imported;
+        if (!ReadStlMesh(path, imported.vertices, imported.indices, (data.importOptimizations & IMPORT_WELD_VERTICES) != 0))
+            return false;
+        unsigned int triangles = (unsigned int)(imported.indices.size() / 3);
+
+        // what Assimp would have made of the file: a vertex per corner
+        data.statsBefore.meshes = 1;
+        data.statsBefore.vertices = triangles * 3;
+        data.statsBefore.indices = triangles * 3;
+        data.statsBefore.materials = 1;
+        data.statsAfter.materials = 1;
+        data.importedMeshes.push_back(std::move(imported));
+        return true;
+    }
+
+    static void addTextureRefs(const std::vector<std::string>& paths, const std::string& typeName, std::vector<TextureRef>& textures) {
+        for (const std::string& path : paths) {
+            TextureRef ref;
+            ref.type = typeName;
+            ref.path = path;
+            textures.push_back(ref);
+        }
     }
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene) {
+    static ImportedMesh processMesh(aiMesh* mesh, const aiScene* scene) {
+        TRACE_SCOPE("import", "processMesh", mesh->mName.C_Str());
         // data to fill
-        std::vector<Vertex> vertices;
-        std::vector<unsigned int> indices;
-        std::vector<Texture> textures;
+        ImportedMesh result;
+        std::vector<Vertex>& vertices = result.vertices;
+        std::vector<unsigned int>& indices = result.indices;
+        std::vector<TextureRef>& textures = result.textures;
         bool texCoords = false;
         // walk through each of the mesh's vertices
         for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
@@ -145,89 +543,204 @@ private:
         // normal: texture_normalN
 
         // 1. diffuse maps
-        std::vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+        std::vector<TextureRef> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
         textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
         // 2. specular maps
-        std::vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+        std::vector<TextureRef> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
         textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
         // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
+        std::vector<TextureRef> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
         textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
         // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
+        std::vector<TextureRef> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        result.materialIndex = mesh->mMaterialIndex;
+
+        // return the extracted mesh data, uploaded later by uploadMesh
+        return result;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName) {
-        std::vector<Texture> textures;
+    /**
+     * Merges meshes with the same material into the first of them, appending vertices and rebasing indices.
+     * Meshes keep the order of their first occurrence.
+     */
+    static void mergeMeshes(std::vector<ImportedMesh>& meshes) {
+        TRACE_SCOPE("optimize", "mergeMeshes");
+        std::vector<ImportedMesh> merged;
+        std::unordered_map<unsigned int, size_t> mergedIndices; // index in merged, keyed by material
+        for (ImportedMesh& mesh : meshes) {
+            auto found = mergedIndices.find(mesh.materialIndex);
+            if (found == mergedIndices.end()) {
+                mergedIndices.emplace(mesh.materialIndex, merged.size());
+                merged.push_back(std::move(mesh));
+                continue;
+            }
+            ImportedMesh& target = merged[found->second];
+            unsigned int base = (unsigned int)target.vertices.size();
+            target.vertices.insert(target.vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+            target.indices.reserve(target.indices.size() + mesh.indices.size());
+            for (unsigned int index : mesh.indices)
+                target.indices.push_back(base + index);
+        }
+        meshes = std::move(merged);
+    }
+
+    // optimizes the triangle and vertex order of every imported mesh, measuring the vertex cache before and after
+    static void reorderMeshes(ModelData& data) {
+        TRACE_SCOPE("optimize", "reorderMeshes", data.path);
+        bool overdraw = (data.importOptimizations & IMPORT_OPTIMIZE_OVERDRAW) != 0;
+        for (ImportedMesh& mesh : data.importedMeshes) {
+            data.cacheBefore.add(MeshOptimizer::analyzeVertexCache(mesh.indices, mesh.vertices.size()));
+            MeshOptimizer::optimize(mesh.vertices, mesh.indices, overdraw);
+            data.cacheAfter.add(MeshOptimizer::analyzeVertexCache(mesh.indices, mesh.vertices.size()));
+        }
+    }
+
+    // measures a scene the way processNode walks it, counting meshes referenced by several nodes each time
+    static ImportStats getImportStats(const aiScene* scene) {
+        ImportStats stats;
+        stats.materials = scene->mNumMaterials;
+        addImportStats(scene->mRootNode, scene, stats);
+        return stats;
+    }
+
+    static void addImportStats(const aiNode* node, const aiScene* scene, ImportStats& stats) {
+        for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+            const aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+            stats.meshes++;
+            stats.vertices += mesh->mNumVertices;
+            for (unsigned int f = 0; f < mesh->mNumFaces; f++)
+                stats.indices += mesh->mFaces[f].mNumIndices;
+        }
+        for (unsigned int i = 0; i < node->mNumChildren; i++)
+            addImportStats(node->mChildren[i], scene, stats);
+    }
+
+    static void printImportStats(const ModelData& data) {
+        const ImportStats& before = data.statsBefore;
+        const ImportStats& after = data.statsAfter;
+        std::cout << "Import optimization " << data.path << ": meshes " << before.meshes << " -> " << after.meshes
+                  << ", vertices " << before.vertices << " -> " << after.vertices
+                  << ", indices " << before.indices << " -> " << after.indices
+                  << ", materials " << before.materials << " -> " << after.materials << "\n";
+        if (data.importOptimizations & IMPORT_OPTIMIZE_VERTEX_CACHE)
+            std::cout << "  vertex cache: ACMR " << data.cacheBefore.getACMR() << " -> " << data.cacheAfter.getACMR()
+                      << ", ATVR " << data.cacheBefore.getATVR() << " -> " << data.cacheAfter.getATVR() << "\n";
+        if (data.importOptimizations & IMPORT_GENERATE_LODS) {
+            unsigned int triangles[Mesh::MAX_LODS] = {};
+            for (const MeshView& mesh : data.meshes)
+                for (unsigned int lod = 0; lod < Mesh::MAX_LODS; lod++)
+                    triangles[lod] += (mesh.lods.empty() ? mesh.numIndices : mesh.lods[std::min(lod, (unsigned int)mesh.lods.size() - 1)].indexCount) / 3;
+            std::cout << "  LOD triangles:";
+            for (unsigned int lod = 0; lod < Mesh::MAX_LODS; lod++)
+                std::cout << (lod ? " -> " : " ") << triangles[lod];
+            std::cout << "\n";
+        }
+    }
+
+    // error budget of each generated level of detail after the first, as a fraction of the mesh's radius.
+    // each level aims for half the triangles of the previous one, and is only kept if it removes at least LOD_MIN_REDUCTION of them.
+    static constexpr float LOD_ERRORS[Mesh::MAX_LODS - 1] = { 0.01f, 0.03f, 0.08f };
+    static constexpr float LOD_MIN_REDUCTION = 0.15f;
+
+    /**
+     * Simplifies a mesh into coarser levels of detail, each from the previous one, and appends their indices to the mesh's.
+     * All levels share the mesh's vertices.
+     */
+    static void generateLODs(ImportedMesh& mesh) {
+        TRACE_SCOPE("optimize", "generateLODs");
+        MeshLOD full;
+        full.indexCount = (unsigned int)mesh.indices.size();
+        std::vector<MeshLOD> lods(1, full);
+        std::vector<unsigned int> previous(mesh.indices);
+        for (unsigned int level = 1; level < Mesh::MAX_LODS; level++) {
+            float error = 0.0f;
+            size_t target = previous.size() / 6 * 3;
+            std::vector<unsigned int> simplified = MeshSimplifier::simplify(mesh.vertices, previous, target, LOD_ERRORS[level - 1], &error);
+            if (simplified.empty() || simplified.size() > previous.size() * (1.0f - LOD_MIN_REDUCTION))
+                break;
+            MeshOptimizer::optimizeVertexCache(simplified, mesh.vertices.size());
+            MeshLOD lod;
+            lod.indexOffset = (unsigned int)mesh.indices.size();
+            lod.indexCount = (unsigned int)simplified.size();
+            lod.error = lods.back().error + error;
+            lods.push_back(lod);
+            mesh.indices.insert(mesh.indices.end(), simplified.begin(), simplified.end());
+            previous.swap(simplified);
+        }
+        if (lods.size() > 1)
+            mesh.lods = lods;
+    }
+
+    // grows the model's bounding sphere to contain another sphere
+    void addBoundingSphere(const glm::vec3& center, float radius) {
+        if (boundingRadius <= 0.0f) {
+            boundingCenter = center;
+            boundingRadius = radius;
+            return;
+        }
+        float distance = glm::length(center - boundingCenter);
+        if (distance + radius <= boundingRadius)
+            return;
+        if (distance + boundingRadius <= radius) {
+            boundingCenter = center;
+            boundingRadius = radius;
+            return;
+        }
+        float newRadius = (distance + boundingRadius + radius) * 0.5f;
+        boundingCenter += (center - boundingCenter) * ((newRadius - boundingRadius) / distance);
+        boundingRadius = newRadius;
+    }
+
+    // grows the model's bounding box to contain another box
+    void addBoundingBox(const glm::vec3& min, const glm::vec3& max) {
+        if (meshes.size() <= 1) {
+            boundsMin = min;
+            boundsMax = max;
+            return;
+        }
+        boundsMin = glm::min(boundsMin, min);
+        boundsMax = glm::max(boundsMax, max);
+    }
+
+    // collects all material textures of a given type. The textures themselves are loaded when the mesh is uploaded.
+    static std::vector<TextureRef> loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName) {
+        std::vector<TextureRef> textures;
         for (unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for (unsigned int j = 0; j < textures_loaded.size(); j++) {
-                if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0) {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if (!skip) {   
-                // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            TextureRef ref;
+            ref.type = typeName;
+            ref.path = str.C_Str();
+            textures.push_back(ref);
         }
         return textures;
     }
-};
 
-/**
- * Method that loads a texture from a file using STBI image
- */
-unsigned int TextureFromFile(const char* path, const std::string& directory, bool gamma) {
-    std::cout << "Loading Texture from file " << path << "\n";
-    std::string filename = std::string(path);
-    filename = directory + '/' + filename;
-   
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data) {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
-}
\ No newline at end of file
+    // indices into textures_loaded, keyed by material path
+    std::unordered_map<std::string, size_t> loadedTextureIndices;
+
+    // loads a single texture of the given type, reusing it if a texture with the same filepath was already loaded by this model.
+    // the image itself comes from the global texture cache, so it is only decoded and uploaded once even if other models use it.
+    Texture loadTexture(const char* path, const std::string& typeName, ModelData& data) {
+        // check if texture was loaded before and if so, skip loading a new texture
+        auto loaded = loadedTextureIndices.find(path);
+        if (loaded != loadedTextureIndices.end())
+            return textures_loaded[loaded->second]; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
+
+        // if texture hasn't been loaded by this model already, get it from the cache
+        TextureCache& cache = TextureCache::instance();
+        auto prepared = data.textures.find(path);
+        TextureHandle handle = prepared != data.textures.end() && prepared->second != INVALID_TEXTURE_HANDLE
+            ? prepared->second : cache.request(this->directory, path);
+        Texture texture;
+        texture.id = cache.getTextureID(handle);
+        textureHandles.push_back(handle);
+        texture.type = typeName;
+        texture.path = path;
+        loadedTextureIndices[texture.path] = textures_loaded.size();
+        textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+        return texture;
+    }
+};
@@ -0,0 +1,238 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <map>
+#include <vector>
+#include <iostream>
+#include "Model.h"
+#include "AssetLoader.h"
+
+/**
+ * How a model is going to be used. Instanced objects add per-instance vertex attributes to their model's VAOs,
+ * so each of them gets its own copy instead of sharing one.
+ */
+enum ModelUsage {
+    MODEL_SHARED,
+    MODEL_INSTANCED
+};
+
+/**
+ * Process-wide registry of loaded models. Each model file is imported and uploaded to the GPU once, and every
+ * GameObject that uses the same file shares that copy through a reference counted pointer. InstancedObjects are
+ * the exception: every one of them gets a model of its own, see ModelUsage. A model is released once the last
+ * object using it is destroyed.
+ *
+ * Every acquire() hands out a pointer with its own reference count, which keeps the model alive and counts one user
+ * until the last copy of it is gone. Copies made from an object's pointer (e.g. by the ImpostorAtlas) therefore don't
+ * count as more users, so the memory saved by sharing only counts the objects that asked for the model.
+ */
+class ModelRegistry {
+public:
+    /**
+     * Gets the single registry used by the whole game.
+     */
+    static ModelRegistry& instance() {
+        static ModelRegistry registry;
+        return registry;
+    }
+
+    /**
+     * Sets the loader used for shared models. While set, new shared models are loaded in the background and
+     * start out empty; instanced models are always loaded right away since their VAOs are configured on construction.
+     * Pass nullptr to go back to loading everything synchronously.
+     */
+    void setAsyncLoader(AssetLoader* loader) {
+        asyncLoader = loader;
+    }
+
+    /**
+     * Sets the shader that models of the given usage are drawn with. Models loaded afterwards skip the texture types
+     * this shader never samples. Pass nullptr to load every texture again.
+     */
+    void setTargetShader(ModelUsage usage, const Shader* shader) {
+        loadOptions[usage].targetShader = shader;
+    }
+
+    /**
+     * Sets the vertex format that models of the given usage are uploaded in, for models loaded afterwards.
+     */
+    void setVertexFormat(ModelUsage usage, VertexFormat format) {
+        loadOptions[usage].vertexFormat = format;
+    }
+
+    /**
+     * Sets the ImportOptimization flags that models of the given usage are imported with, for models loaded afterwards.
+     */
+    void setImportOptimizations(ModelUsage usage, unsigned int optimizations) {
+        loadOptions[usage].importOptimizations = optimizations;
+    }
+
+    /**
+     * Sets what the meshes of models of the given usage keep in system memory once uploaded, for models loaded afterwards.
+     */
+    void setResidency(ModelUsage usage, MeshResidency residency) {
+        loadOptions[usage].residency = residency;
+    }
+
+    /**
+     * Gets the shared model for a file, loading it if no live object is using it yet. Instanced usage always loads
+     * a new model, which only the caller uses.
+     */
+    std::shared_ptr<Model> acquire(const std::string& path, ModelUsage usage = MODEL_SHARED) {
+        // every instanced copy is an entry of its own, so it still shows up in getLiveModels() and the stats
+        std::string key = usage == MODEL_INSTANCED ? path + "#instanced" + std::to_string(instancedCopies++) : path;
+        Entry& entry = entries[key];
+        std::shared_ptr<Model> model = entry.model.lock();
+        if (model)
+            sharedHits++;
+        else {
+            if (asyncLoader && usage == MODEL_SHARED)
+                model = asyncLoader->load(path, loadOptions[usage]);
+            else
+                model = std::make_shared<Model>(path, false, loadOptions[usage]);
+            entry.model = model;
+            loads++;
+        }
+        // the deleter holds the model, and gives up its user once every copy of this acquisition is gone
+        std::shared_ptr<unsigned int> users = entry.users;
+        (*users)++;
+        return std::shared_ptr<Model>(model.get(), [model, users](Model*) mutable {
+            (*users)--;
+            model.reset();
+        });
+    }
+
+    /**
+     * Gets the number of objects currently using a model of a file, i.e. live acquire() results.
+     * For instanced usage, that is the number of live copies.
+     */
+    unsigned int getUserCount(const std::string& path, ModelUsage usage = MODEL_SHARED) const {
+        if (usage == MODEL_SHARED) {
+            auto found = entries.find(path);
+            return found != entries.end() ? *found->second.users : 0;
+        }
+        unsigned int users = 0;
+        std::string prefix = path + "#instanced";
+        for (auto it = entries.lower_bound(prefix); it != entries.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it)
+            users += *it->second.users;
+        return users;
+    }
+
+    /**
+     * Gets every model that is still used by some object.
+     */
+    std::vector<std::shared_ptr<Model>> getLiveModels() const {
+        std::vector<std::shared_ptr<Model>> models;
+        for (const auto& pair : entries)
+            if (std::shared_ptr<Model> model = pair.second.model.lock())
+                models.push_back(model);
+        return models;
+    }
+
+    /**
+     * Gets the number of model files actually loaded from disk.
+     */
+    unsigned int getLoadCount() const {
+        return loads;
+    }
+
+    /**
+     * Gets the number of requests that were served by an already loaded model.
+     */
+    unsigned int getSharedHitCount() const {
+        return sharedHits;
+    }
+
+    /**
+     * Gets the GPU memory currently used by all live models.
+     */
+    size_t getLiveBytes() const {
+        size_t bytes = 0;
+        for (const auto& pair : entries)
+            if (std::shared_ptr<Model> model = pair.second.model.lock())
+                bytes += model->getGpuBytes();
+        return bytes;
+    }
+
+    /**
+     * Gets the GPU memory that would be used if every object using a model had its own copy, minus what is actually used.
+     */
+    size_t getSavedBytes() const {
+        size_t bytes = 0;
+        for (const auto& pair : entries) {
+            unsigned int users = *pair.second.users;
+            if (std::shared_ptr<Model> model = pair.second.model.lock())
+                if (users > 1)
+                    bytes += (users - 1) * model->getGpuBytes();
+        }
+        return bytes;
+    }
+
+    /**
+     * Gets the system memory used by the mesh data the live models keep after upload.
+     */
+    size_t getCpuBytes() const {
+        size_t bytes = 0;
+        for (const auto& pair : entries)
+            if (std::shared_ptr<Model> model = pair.second.model.lock())
+                bytes += model->getCpuBytes();
+        return bytes;
+    }
+
+    /**
+     * Gets the system memory saved by live models releasing their vertices and indices after upload.
+     */
+    size_t getReleasedCpuBytes() const {
+        size_t bytes = 0;
+        for (const auto& pair : entries)
+            if (std::shared_ptr<Model> model = pair.second.model.lock())
+                bytes += model->getReleasedCpuBytes();
+        return bytes;
+    }
+
+    /**
+     * Gets the texture memory the live models would additionally use if they loaded texture types their shader doesn't sample.
+     */
+    size_t getSkippedTextureBytes() const {
+        size_t bytes = 0;
+        for (const auto& pair : entries)
+            if (std::shared_ptr<Model> model = pair.second.model.lock())
+                bytes += model->skippedTextureBytes;
+        return bytes;
+    }
+
+    /**
+     * Prints a summary of loaded models, their number of users and the memory saved by sharing them.
+     */
+    void printStats() const {
+        std::cout << "Model Registry: " << loads << " model files loaded, " << sharedHits << " shared hits\n";
+        for (const auto& pair : entries) {
+            unsigned int users = *pair.second.users;
+            if (std::shared_ptr<Model> model = pair.second.model.lock())
+                std::cout << "    " << pair.first << ": " << users << " users, " << model->getGpuBytes() / 1024 << " KB\n";
+        }
+        std::cout << "Model Registry: " << getLiveBytes() / (1024 * 1024) << " MB in use, "
+                  << getSavedBytes() / (1024 * 1024) << " MB saved by sharing, "
+                  << getSkippedTextureBytes() / (1024 * 1024) << " MB of unsampled textures skipped\n";
+        std::cout << "Model Registry: " << getCpuBytes() / (1024 * 1024) << " MB of mesh data in system memory, "
+                  << getReleasedCpuBytes() / (1024 * 1024) << " MB released after upload\n";
+    }
+
+private:
+    struct Entry {
+        std::weak_ptr<Model> model;
+        // live acquire() results; shared with their deleters, so it stays valid whichever goes first
+        std::shared_ptr<unsigned int> users = std::make_shared<unsigned int>(0);
+    };
+
+    std::map<std::string, Entry> entries;
+    unsigned int loads = 0;
+    unsigned int sharedHits = 0;
+    unsigned int instancedCopies = 0; // numbers the keys of instanced models
+    AssetLoader* asyncLoader = nullptr;
+    ModelLoadOptions loadOptions[2]; // indexed by ModelUsage
+
+    ModelRegistry() {}
+    ModelRegistry(const ModelRegistry&) = delete;
+    ModelRegistry& operator=(const ModelRegistry&) = delete;
+};
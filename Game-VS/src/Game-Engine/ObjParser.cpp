@@ -0,0 +1,650 @@
+///
+/// @file ObjParser.cpp
+///
+/// Multithreaded OBJ/MTL parser, see ObjParser.h. Kept out of the header since it is only used when importing models.
+///
+#include "ObjParser.h"
+#include "MappedFile.h"
+#include "Trace.h"
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <cctype>
+#include <atomic>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <unordered_map>
+#include <algorithm>
+
+namespace {
+
+// corner of a triangle: 0-based indices into the positions, texture coordinates and normals, -1 if absent
+struct Corner {
+    int v, t, n;
+};
+
+// start of a run of triangles using a material, as named by usemtl
+struct MaterialUse {
+    size_t triangle;
+    std::string name;
+};
+
+// what one thread parsed out of a range of lines
+struct Chunk {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texCoords;
+    std::vector<glm::vec3> normals;
+    std::vector<Corner> corners;        // three per triangle
+    std::vector<uint32_t> fixups;       // corner * 3 + component of the indices relative to this chunk's attributes
+    std::vector<MaterialUse> materials;
+    std::vector<std::string> libraries; // mtllib arguments
+    size_t numLines = 0;
+    size_t errorLine = 0;               // 1-based line in the chunk of the first malformed line, 0 if none
+};
+
+// range of triangles of a chunk using one material
+struct TriangleRun {
+    const Chunk* chunk;
+    size_t begin, end;
+};
+
+// exact powers of ten for double precision
+const double POWERS_OF_10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline const char* skipBlanks(const char* p, const char* end) {
+    while (p < end && isBlank(*p))
+        p++;
+    return p;
+}
+
+// checks if a line starts with a keyword followed by a blank or the end of the line
+inline bool isKeyword(const char* p, const char* end, const char* keyword, size_t length) {
+    return (size_t)(end - p) >= length && std::memcmp(p, keyword, length) == 0 && (p + length == end || isBlank(p[length]));
+}
+
+// gets the rest of a line without its surrounding blanks
+std::string getArgument(const char* p, const char* end) {
+    p = skipBlanks(p, end);
+    while (end > p && isBlank(end[-1]))
+        end--;
+    return std::string(p, end);
+}
+
+// parses a face index: a positive 1-based index, or a negative index counting back from the last attribute read
+inline const char* parseIndex(const char* p, const char* end, int& value, bool& relative) {
+    relative = p < end && *p == '-';
+    if (relative)
+        p++;
+    if (p >= end || !isDigit(*p))
+        return nullptr;
+    int64_t number = 0;
+    while (p < end && isDigit(*p)) {
+        number = number * 10 + (*p - '0');
+        if (number > INT32_MAX)
+            return nullptr;
+        p++;
+    }
+    if (number == 0)
+        return nullptr;
+    value = relative ? -(int)number : (int)number - 1;
+    return p;
+}
+
+// parses a face line into fan triangles. Returns false if it is malformed.
+bool parseFace(const char* p, const char* end, Chunk& chunk) {
+    // corners are read straight into the fan: the first corner, then each new edge
+    Corner first, previous;
+    unsigned int count = 0;
+    uint32_t relativeMask[3] = {};
+    while (true) {
+        p = skipBlanks(p, end);
+        if (p >= end)
+            break;
+        Corner corner = { -1, -1, -1 };
+        int* components[3] = { &corner.v, &corner.t, &corner.n };
+        const int counts[3] = { (int)chunk.positions.size(), (int)chunk.texCoords.size(), (int)chunk.normals.size() };
+        uint32_t relative = 0;
+        for (unsigned int component = 0; component < 3; component++) {
+            if (component > 0) {
+                if (p >= end || *p != '/')
+                    break;
+                p++;
+                // "v//n" has no texture coordinate
+                if (component == 1 && p < end && *p == '/')
+                    continue;
+            }
+            bool isRelative;
+            p = parseIndex(p, end, *components[component], isRelative);
+            if (!p)
+                return false;
+            if (isRelative) {
+                // relative to this chunk's attributes for now; the attributes of the chunks before are added later
+                *components[component] += counts[component];
+                relative |= 1u << component;
+            }
+        }
+        if (p < end && !isBlank(*p))
+            return false;
+
+        if (count == 0) {
+            first = corner;
+            relativeMask[0] = relative;
+        }
+        else if (count >= 2) {
+            Corner triangle[3] = { first, previous, corner };
+            uint32_t masks[3] = { relativeMask[0], relativeMask[1], relative };
+            for (unsigned int i = 0; i < 3; i++) {
+                for (unsigned int component = 0; component < 3; component++)
+                    if (masks[i] & (1u << component))
+                        chunk.fixups.push_back((uint32_t)(chunk.corners.size() * 3 + component));
+                chunk.corners.push_back(triangle[i]);
+            }
+        }
+        previous = corner;
+        relativeMask[1] = relative;
+        count++;
+    }
+    return count >= 3;
+}
+
+// parses whole lines between begin and end
+void parseChunk(Chunk& chunk) {
+    const char* p = chunk.begin;
+    while (p < chunk.end) {
+        const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', chunk.end - p));
+        if (!lineEnd)
+            lineEnd = chunk.end;
+        chunk.numLines++;
+        const char* line = skipBlanks(p, lineEnd);
+        p = lineEnd + 1;
+        if (line >= lineEnd)
+            continue;
+
+        bool valid = true;
+        if (line[0] == 'v' && line + 1 < lineEnd && isBlank(line[1])) {
+            glm::vec3 position;
+            const char* q = line + 1;
+            for (int i = 0; i < 3 && q; i++)
+                q = ObjParser::parseFloat(q, lineEnd, position[i]);
+            valid = q != nullptr;
+            chunk.positions.push_back(position);
+        }
+        else if (isKeyword(line, lineEnd, "vt", 2)) {
+            glm::vec2 texCoord(0.0f);
+            const char* q = ObjParser::parseFloat(line + 2, lineEnd, texCoord.x);
+            // the vertical coordinate is optional
+            if (q && skipBlanks(q, lineEnd) < lineEnd)
+                q = ObjParser::parseFloat(q, lineEnd, texCoord.y);
+            valid = q != nullptr;
+            chunk.texCoords.push_back(texCoord);
+        }
+        else if (isKeyword(line, lineEnd, "vn", 2)) {
+            glm::vec3 normal;
+            const char* q = line + 2;
+            for (int i = 0; i < 3 && q; i++)
+                q = ObjParser::parseFloat(q, lineEnd, normal[i]);
+            valid = q != nullptr;
+            chunk.normals.push_back(normal);
+        }
+        else if (isKeyword(line, lineEnd, "f", 1))
+            valid = parseFace(line + 1, lineEnd, chunk);
+        else if (isKeyword(line, lineEnd, "usemtl", 6))
+            chunk.materials.push_back({ chunk.corners.size() / 3, getArgument(line + 6, lineEnd) });
+        else if (isKeyword(line, lineEnd, "mtllib", 6))
+            chunk.libraries.push_back(getArgument(line + 6, lineEnd));
+        // comments, groups, objects, smoothing groups, lines and points are ignored
+
+        if (!valid) {
+            chunk.errorLine = chunk.numLines;
+            return;
+        }
+    }
+}
+
+// runs a job for every index in [0, count) on up to numThreads threads, including the calling one
+template <typename Job>
+void runParallel(size_t count, unsigned int numThreads, const Job& job) {
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        for (size_t i = next++; i < count; i = next++)
+            job(i);
+    };
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < std::min((size_t)numThreads, count); i++)
+        threads.emplace_back(work);
+    work();
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+// open addressing hash table from corners to vertex indices, grown to stay at most 3/4 full
+class CornerTable {
+public:
+    explicit CornerTable(size_t expectedVertices) {
+        size_t capacity = 16;
+        while (capacity * 3 < expectedVertices * 4)
+            capacity *= 2;
+        slots.assign(capacity, EMPTY);
+    }
+
+    // gets the vertex of a corner, or adds it as the next vertex
+    uint32_t insert(const Corner& corner, std::vector<Corner>& keys) {
+        if ((keys.size() + 1) * 4 > slots.size() * 3)
+            grow(keys);
+        size_t mask = slots.size() - 1;
+        size_t slot = hash(corner) & mask;
+        while (slots[slot] != EMPTY) {
+            const Corner& key = keys[slots[slot]];
+            if (key.v == corner.v && key.t == corner.t && key.n == corner.n)
+                return slots[slot];
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = (uint32_t)keys.size();
+        keys.push_back(corner);
+        return slots[slot];
+    }
+
+private:
+    static constexpr uint32_t EMPTY = ~0u;
+    std::vector<uint32_t> slots;
+
+    static size_t hash(const Corner& corner) {
+        uint64_t h = (uint64_t)(uint32_t)corner.v * 0x9E3779B97F4A7C15ull;
+        h ^= (uint64_t)(uint32_t)corner.t * 0xC2B2AE3D27D4EB4Full + (h >> 29);
+        h ^= (uint64_t)(uint32_t)corner.n * 0x165667B19E3779F9ull + (h >> 32);
+        return (size_t)(h ^ (h >> 31));
+    }
+
+    void grow(const std::vector<Corner>& keys) {
+        slots.assign(slots.size() * 2, EMPTY);
+        size_t mask = slots.size() - 1;
+        for (uint32_t i = 0; i < keys.size(); i++) {
+            size_t slot = hash(keys[i]) & mask;
+            while (slots[slot] != EMPTY)
+                slot = (slot + 1) & mask;
+            slots[slot] = i;
+        }
+    }
+};
+
+// attributes of the whole file, in file order
+struct Attributes {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texCoords;
+    std::vector<glm::vec3> normals;
+};
+
+// sets the normals of the vertices that have none to the area weighted average of their triangles' normals
+void generateNormals(ObjMesh& mesh, const std::vector<bool>& missing) {
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+        unsigned int a = mesh.indices[i], b = mesh.indices[i + 1], c = mesh.indices[i + 2];
+        glm::vec3 normal = glm::cross(mesh.vertices[b].Position - mesh.vertices[a].Position, mesh.vertices[c].Position - mesh.vertices[a].Position);
+        for (unsigned int vertex : { a, b, c })
+            if (missing[vertex])
+                mesh.vertices[vertex].Normal += normal;
+    }
+    for (size_t i = 0; i < mesh.vertices.size(); i++) {
+        float length = glm::length(mesh.vertices[i].Normal);
+        if (missing[i] && length > 0.0f)
+            mesh.vertices[i].Normal /= length;
+    }
+}
+
+// computes per vertex tangents and bitangents from the texture coordinates, orthogonal to the normal
+void generateTangents(ObjMesh& mesh) {
+    std::vector<glm::vec3> tangents(mesh.vertices.size(), glm::vec3(0.0f)), bitangents(mesh.vertices.size(), glm::vec3(0.0f));
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+        const Vertex& a = mesh.vertices[mesh.indices[i]];
+        const Vertex& b = mesh.vertices[mesh.indices[i + 1]];
+        const Vertex& c = mesh.vertices[mesh.indices[i + 2]];
+        glm::vec3 edge1 = b.Position - a.Position, edge2 = c.Position - a.Position;
+        glm::vec2 delta1 = b.TexCoords - a.TexCoords, delta2 = c.TexCoords - a.TexCoords;
+        float determinant = delta1.x * delta2.y - delta2.x * delta1.y;
+        if (std::abs(determinant) < 1e-12f)
+            continue;
+        float r = 1.0f / determinant;
+        glm::vec3 tangent = (edge1 * delta2.y - edge2 * delta1.y) * r;
+        glm::vec3 bitangent = (edge2 * delta1.x - edge1 * delta2.x) * r;
+        for (size_t j = i; j < i + 3; j++) {
+            tangents[mesh.indices[j]] += tangent;
+            bitangents[mesh.indices[j]] += bitangent;
+        }
+    }
+    auto orthogonalize = [](const glm::vec3& v, const glm::vec3& normal) {
+        glm::vec3 projected = v - normal * glm::dot(normal, v);
+        float length = glm::length(projected);
+        return length > 0.0f ? projected / length : glm::vec3(0.0f);
+    };
+    for (size_t i = 0; i < mesh.vertices.size(); i++) {
+        Vertex& vertex = mesh.vertices[i];
+        vertex.Tangent = orthogonalize(tangents[i], vertex.Normal);
+        vertex.Bitangent = orthogonalize(bitangents[i], vertex.Normal);
+    }
+}
+
+// gathers the triangles of one material into a mesh
+void buildMesh(const std::vector<TriangleRun>& runs, const Attributes& attributes, const ObjParseOptions& options, ObjMesh& mesh) {
+    size_t numCorners = 0;
+    for (const TriangleRun& run : runs)
+        numCorners += (run.end - run.begin) * 3;
+    // closed meshes have about one vertex for every six corners; open and faceted ones more
+    size_t expectedVertices = options.weldVertices ? numCorners / 4 : numCorners;
+    std::vector<Corner> keys;
+    keys.reserve(expectedVertices);
+    mesh.indices.reserve(numCorners);
+    if (options.weldVertices) {
+        CornerTable table(expectedVertices);
+        for (const TriangleRun& run : runs)
+            for (size_t i = run.begin * 3; i < run.end * 3; i++)
+                mesh.indices.push_back(table.insert(run.chunk->corners[i], keys));
+    }
+    else
+        for (const TriangleRun& run : runs)
+            for (size_t i = run.begin * 3; i < run.end * 3; i++) {
+                mesh.indices.push_back((unsigned int)keys.size());
+                keys.push_back(run.chunk->corners[i]);
+            }
+
+    mesh.vertices.resize(keys.size());
+    std::vector<bool> missingNormals(keys.size(), false);
+    bool anyMissing = false;
+    for (size_t i = 0; i < keys.size(); i++) {
+        Vertex& vertex = mesh.vertices[i];
+        const Corner& key = keys[i];
+        vertex.Position = attributes.positions[key.v];
+        vertex.TexCoords = key.t >= 0 ? attributes.texCoords[key.t] : glm::vec2(0.0f);
+        if (options.flipTexCoords && key.t >= 0)
+            vertex.TexCoords.y = 1.0f - vertex.TexCoords.y;
+        vertex.Normal = key.n >= 0 ? attributes.normals[key.n] : glm::vec3(0.0f);
+        missingNormals[i] = key.n < 0;
+        anyMissing |= key.n < 0;
+    }
+    if (anyMissing)
+        generateNormals(mesh, missingNormals);
+    generateTangents(mesh);
+}
+
+// splits a texture statement into its file name, skipping options such as "-bm 0.5" wherever they are
+std::string getTexturePath(const std::string& argument) {
+    static const std::unordered_map<std::string, int> OPTION_ARGUMENTS = {
+        { "-blendu", 1 }, { "-blendv", 1 }, { "-bm", 1 }, { "-boost", 1 }, { "-cc", 1 }, { "-clamp", 1 }, { "-imfchan", 1 },
+        { "-mm", 2 }, { "-o", 3 }, { "-s", 3 }, { "-t", 3 }, { "-texres", 1 }, { "-type", 1 }
+    };
+    std::istringstream stream(argument);
+    std::vector<std::string> tokens;
+    for (std::string token; stream >> token;)
+        tokens.push_back(token);
+    std::string path;
+    for (size_t i = 0; i < tokens.size(); i++) {
+        auto option = OPTION_ARGUMENTS.find(tokens[i]);
+        if (option != OPTION_ARGUMENTS.end()) {
+            // -o, -s and -t take one to three numbers
+            for (int j = 0; j < option->second && i + 1 < tokens.size(); j++) {
+                float number;
+                const std::string& next = tokens[i + 1];
+                if (j > 0 && !ObjParser::parseFloat(next.data(), next.data() + next.size(), number))
+                    break;
+                i++;
+            }
+            continue;
+        }
+        // file names may contain spaces
+        path += (path.empty() ? "" : " ") + tokens[i];
+    }
+    return path;
+}
+
+bool equalsIgnoreCase(const std::string& a, const char* b) {
+    size_t length = std::strlen(b);
+    if (a.size() != length)
+        return false;
+    for (size_t i = 0; i < length; i++)
+        if (std::tolower((unsigned char)a[i]) != std::tolower((unsigned char)b[i]))
+            return false;
+    return true;
+}
+
+} // namespace
+
+const char* ObjParser::parseFloat(const char* p, const char* end, float& value) {
+    p = skipBlanks(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    // up to 19 significant digits fit in the mantissa; the rest only moves the exponent
+    uint64_t mantissa = 0;
+    int exponent = 0, digits = 0;
+    bool any = false;
+    for (; p < end && isDigit(*p); p++, any = true) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += mantissa != 0;
+        }
+        else
+            exponent++;
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && isDigit(*p); p++, any = true) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+                exponent--;
+            }
+        }
+    }
+    if (!any)
+        return nullptr;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        bool negativeExponent = false;
+        if (q < end && (*q == '-' || *q == '+')) {
+            negativeExponent = *q == '-';
+            q++;
+        }
+        if (q < end && isDigit(*q)) {
+            int e = 0;
+            for (; q < end && isDigit(*q); q++)
+                e = std::min(e * 10 + (*q - '0'), 10000);
+            exponent += negativeExponent ? -e : e;
+            p = q;
+        }
+    }
+    double result = (double)mantissa;
+    if (mantissa != 0) {
+        if (exponent >= 0 && exponent <= 22)
+            result *= POWERS_OF_10[exponent];
+        else if (exponent < 0 && exponent >= -22)
+            result /= POWERS_OF_10[-exponent];
+        else
+            result *= std::pow(10.0, (double)exponent);
+    }
+    value = (float)(negative ? -result : result);
+    return p;
+}
+
+bool ObjParser::parseMaterials(const std::string& path, std::vector<ObjMaterial>& materials) {
+    std::ifstream file(path);
+    if (!file)
+        return false;
+    ObjMaterial* material = nullptr;
+    for (std::string line; std::getline(file, line);) {
+        std::istringstream stream(line);
+        std::string keyword;
+        if (!(stream >> keyword) || keyword[0] == '#')
+            continue;
+        std::string argument = getArgument(line.data() + line.find(keyword) + keyword.size(), line.data() + line.size());
+        if (keyword == "newmtl") {
+            materials.emplace_back();
+            material = &materials.back();
+            material->name = argument;
+            continue;
+        }
+        if (!material)
+            continue;
+        std::vector<std::string>* maps = nullptr;
+        if (equalsIgnoreCase(keyword, "map_Kd"))
+            maps = &material->diffuseMaps;
+        else if (equalsIgnoreCase(keyword, "map_Ks"))
+            maps = &material->specularMaps;
+        else if (equalsIgnoreCase(keyword, "map_Bump") || equalsIgnoreCase(keyword, "bump"))
+            maps = &material->bumpMaps;
+        else if (equalsIgnoreCase(keyword, "map_Ka"))
+            maps = &material->ambientMaps;
+        std::string texturePath = maps ? getTexturePath(argument) : std::string();
+        if (!texturePath.empty())
+            maps->push_back(texturePath);
+    }
+    return true;
+}
+
+bool ObjParser::parse(const std::string& path, ObjModel& model, const ObjParseOptions& options, std::string* error) {
+    TRACE_SCOPE("import", "ObjParser::parse", path);
+    auto fail = [&](const std::string& message) {
+        if (error)
+            *error = message;
+        return false;
+    };
+    MappedFile file(path);
+    if (!file.isOpen())
+        return fail("could not open " + path);
+    const char* data = reinterpret_cast<const char*>(file.data());
+    const char* dataEnd = data + file.size();
+
+    // split the file into chunks of whole lines
+    unsigned int numThreads = options.numThreads ? options.numThreads : std::max(1u, std::thread::hardware_concurrency());
+    size_t numChunks = std::max((size_t)1, std::min((size_t)numThreads, file.size() / MIN_CHUNK_SIZE));
+    std::vector<Chunk> chunks(numChunks);
+    const char* begin = data;
+    for (size_t i = 0; i < numChunks; i++) {
+        const char* end = i + 1 == numChunks ? dataEnd : data + file.size() * (i + 1) / numChunks;
+        if (end < begin)
+            end = begin;
+        const char* newline = static_cast<const char*>(std::memchr(end, '\n', dataEnd - end));
+        end = newline ? newline + 1 : dataEnd;
+        chunks[i].begin = begin;
+        chunks[i].end = end;
+        begin = end;
+    }
+    runParallel(numChunks, numThreads, [&](size_t i) { parseChunk(chunks[i]); });
+
+    // concatenate the attributes and make every index absolute
+    Attributes attributes;
+    size_t numLines = 0, numPositions = 0, numTexCoords = 0, numNormals = 0, numTriangles = 0;
+    for (Chunk& chunk : chunks) {
+        if (chunk.errorLine)
+            return fail(path + ": malformed line " + std::to_string(numLines + chunk.errorLine));
+        numLines += chunk.numLines;
+        const int bases[3] = { (int)numPositions, (int)numTexCoords, (int)numNormals };
+        for (uint32_t fixup : chunk.fixups) {
+            Corner& corner = chunk.corners[fixup / 3];
+            int* components[3] = { &corner.v, &corner.t, &corner.n };
+            *components[fixup % 3] += bases[fixup % 3];
+        }
+        numPositions += chunk.positions.size();
+        numTexCoords += chunk.texCoords.size();
+        numNormals += chunk.normals.size();
+        numTriangles += chunk.corners.size() / 3;
+    }
+    if (numTriangles == 0)
+        return fail(path + ": no faces");
+    attributes.positions.reserve(numPositions);
+    attributes.texCoords.reserve(numTexCoords);
+    attributes.normals.reserve(numNormals);
+    for (const Chunk& chunk : chunks) {
+        attributes.positions.insert(attributes.positions.end(), chunk.positions.begin(), chunk.positions.end());
+        attributes.texCoords.insert(attributes.texCoords.end(), chunk.texCoords.begin(), chunk.texCoords.end());
+        attributes.normals.insert(attributes.normals.end(), chunk.normals.begin(), chunk.normals.end());
+        for (const Corner& corner : chunk.corners)
+            if (corner.v < 0 || corner.v >= (int)numPositions || corner.t >= (int)numTexCoords || corner.n >= (int)numNormals ||
+                corner.t < -1 || corner.n < -1)
+                return fail(path + ": face index out of range");
+    }
+
+    // materials of the libraries, loaded from the OBJ file's directory. A library name may contain spaces,
+    // so the whole argument is tried first and then each of its words
+    std::filesystem::path directory = std::filesystem::path(path).parent_path();
+    std::vector<std::string> loadedLibraries;
+    for (const Chunk& chunk : chunks)
+        for (const std::string& library : chunk.libraries) {
+            if (std::find(loadedLibraries.begin(), loadedLibraries.end(), library) != loadedLibraries.end())
+                continue;
+            loadedLibraries.push_back(library);
+            if (parseMaterials((directory / library).string(), model.materials))
+                continue;
+            std::istringstream words(library);
+            for (std::string word; words >> word;)
+                parseMaterials((directory / word).string(), model.materials);
+        }
+    std::unordered_map<std::string, unsigned int> materialIndices;
+    for (unsigned int i = 0; i < model.materials.size(); i++)
+        materialIndices.emplace(model.materials[i].name, i);
+    auto getMaterial = [&](const std::string& name) {
+        auto found = materialIndices.find(name);
+        if (found != materialIndices.end())
+            return found->second;
+        // faces before any usemtl, or a material missing from the libraries, get a material without textures
+        ObjMaterial material;
+        material.name = name;
+        model.materials.push_back(material);
+        materialIndices.emplace(name, (unsigned int)model.materials.size() - 1);
+        return (unsigned int)model.materials.size() - 1;
+    };
+
+    // group the triangles by material, keeping the material of the previous chunk until a chunk's first usemtl
+    std::vector<std::vector<TriangleRun>> runs;
+    std::vector<unsigned int> meshMaterials;
+    std::unordered_map<unsigned int, size_t> meshIndices;
+    std::string current;
+    unsigned int lastMaterial = ~0u;
+    bool lastRunEndsChunk = false;
+    auto addRun = [&](const Chunk& chunk, size_t begin, size_t end) {
+        if (begin >= end)
+            return;
+        unsigned int material = getMaterial(current);
+        auto mesh = meshIndices.find(material);
+        if (mesh == meshIndices.end()) {
+            mesh = meshIndices.emplace(material, runs.size()).first;
+            runs.emplace_back();
+            meshMaterials.push_back(material);
+        }
+        runs[mesh->second].push_back({ &chunk, begin, end });
+        // a run only continuing the previous one across a chunk boundary is still the same group
+        if (!(begin == 0 && material == lastMaterial && lastRunEndsChunk))
+            model.numGroups++;
+        lastMaterial = material;
+        lastRunEndsChunk = end == chunk.corners.size() / 3;
+    };
+    for (const Chunk& chunk : chunks) {
+        size_t start = 0;
+        for (const MaterialUse& use : chunk.materials) {
+            addRun(chunk, start, use.triangle);
+            start = use.triangle;
+            current = use.name;
+        }
+        addRun(chunk, start, chunk.corners.size() / 3);
+    }
+
+    // as many threads as parsed the file, so small files don't start threads for a handful of meshes
+    model.meshes.resize(runs.size());
+    runParallel(runs.size(), (unsigned int)numChunks, [&](size_t i) {
+        buildMesh(runs[i], attributes, options, model.meshes[i]);
+        model.meshes[i].materialIndex = meshMaterials[i];
+    });
+    model.numCorners = (unsigned int)(numTriangles * 3);
+    return true;
+}
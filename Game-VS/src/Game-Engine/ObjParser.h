@@ -0,0 +1,80 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "VertexLayout.h"
+
+/**
+ * Material of an OBJ file, read from its MTL libraries. Texture paths are as written in the library,
+ * i.e. relative to the directory of the OBJ file.
+ */
+struct ObjMaterial {
+    std::string name;
+    std::vector<std::string> diffuseMaps;  // map_Kd
+    std::vector<std::string> specularMaps; // map_Ks
+    std::vector<std::string> bumpMaps;     // map_Bump, bump
+    std::vector<std::string> ambientMaps;  // map_Ka
+};
+
+/**
+ * Triangles of an OBJ file using one material, with de-duplicated vertices.
+ */
+struct ObjMesh {
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    unsigned int materialIndex = 0; // index in ObjModel::materials
+};
+
+/**
+ * Result of parsing an OBJ file.
+ */
+struct ObjModel {
+    std::vector<ObjMesh> meshes;        // one per material used by faces, in order of first use
+    std::vector<ObjMaterial> materials; // every material of the libraries, then the ones only named by usemtl
+    unsigned int numCorners = 0;        // corners of the triangulated faces, i.e. vertices before de-duplication
+    unsigned int numGroups = 0;         // runs of faces using the same material
+};
+
+/**
+ * Settings of ObjParser::parse.
+ */
+struct ObjParseOptions {
+    unsigned int numThreads = 0; // threads to parse with; 0 for one per hardware thread, 1 to stay on the calling one
+    bool weldVertices = true;    // share a vertex between all corners with the same position, texture coordinate and normal
+    bool flipTexCoords = true;   // store 1 - v as the vertical texture coordinate, like aiProcess_FlipUVs
+};
+
+/**
+ * Fast loader of Wavefront OBJ files and their MTL material libraries, used by Model instead of Assimp for OBJ files.
+ *
+ * The file is memory mapped and split into chunks at line boundaries, which are parsed in parallel with a hand-written
+ * number parser into per-chunk attribute and face arrays. Indices relative to the end of the attribute lists (negative
+ * indices) are resolved once the chunks' sizes are known. Faces are then gathered per material and their corners
+ * de-duplicated through a hash table, one material per thread. Polygons are triangulated as fans.
+ *
+ * Vertices without a normal in the file get the average normal of their faces. Tangents and bitangents are computed
+ * from the texture coordinates, like aiProcess_CalcTangentSpace.
+ */
+class ObjParser {
+public:
+    // files smaller than this are parsed on a single thread; each extra thread gets at least this much of the file
+    static const size_t MIN_CHUNK_SIZE = 1 << 20;
+
+    /**
+     * Parses an OBJ file and the material libraries it references. Thread-safe.
+     * Returns false if the file can't be read or is malformed, with the reason in error if provided.
+     */
+    static bool parse(const std::string& path, ObjModel& model, const ObjParseOptions& options = ObjParseOptions(),
+                      std::string* error = nullptr);
+
+    /**
+     * Parses an MTL material library, appending its materials. Returns false if the file can't be read.
+     */
+    static bool parseMaterials(const std::string& path, std::vector<ObjMaterial>& materials);
+
+    /**
+     * Parses a decimal floating point number (with optional sign, fraction and exponent) after optional spaces and tabs.
+     * Returns the position after the number, or nullptr if there is no number.
+     */
+    static const char* parseFloat(const char* p, const char* end, float& value);
+};
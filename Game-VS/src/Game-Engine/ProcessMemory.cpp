@@ -0,0 +1,44 @@
+///
+/// @file ProcessMemory.cpp
+///
+/// Platform specific parts of ProcessMemory.h. Kept out of the header so that <windows.h> isn't pulled into
+/// every file that includes it.
+///
+#include "ProcessMemory.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+
+size_t GetResidentBytes() {
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return (size_t)counters.WorkingSetSize;
+}
+
+#elif defined(__linux__)
+#include <cstdio>
+#include <unistd.h>
+
+size_t GetResidentBytes() {
+    FILE* file = std::fopen("/proc/self/statm", "r");
+    if (!file)
+        return 0;
+    unsigned long long pages = 0, residentPages = 0;
+    int read = std::fscanf(file, "%llu %llu", &pages, &residentPages);
+    std::fclose(file);
+    if (read != 2)
+        return 0;
+    return (size_t)residentPages * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+#else
+
+size_t GetResidentBytes() {
+    return 0;
+}
+
+#endif
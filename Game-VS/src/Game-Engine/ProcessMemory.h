@@ -0,0 +1,8 @@
+#pragma once
+#include <cstddef>
+
+/**
+ * Gets the resident set size of the process (the working set on Windows): the system memory its pages currently occupy.
+ * Returns 0 if the platform doesn't report it.
+ */
+size_t GetResidentBytes();
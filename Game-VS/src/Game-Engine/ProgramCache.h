@@ -0,0 +1,161 @@
+#pragma once
+#include <glad.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "FileCache.h"
+#include "MappedFile.h"
+#include "Trace.h"
+
+/**
+ * On-disk cache of linked shader programs, stored as the driver's program binaries (glGetProgramBinary) under
+ * res/cache/shaders/. A program is keyed by the text of its stages and by the GL vendor, renderer and version
+ * strings, so editing a shader or updating the driver makes a new entry instead of loading a stale one.
+ *
+ * Drivers may reject a binary they wrote themselves (e.g. after an update that kept the version string), so load()
+ * checks the link status and the caller compiles from source whenever it returns false.
+ *
+ * File layout (little endian):
+ *   ProgramCacheHeader | program binary
+ */
+class ProgramCache {
+public:
+    // bump whenever the layout of the file changes so that stale caches are ignored
+    static const uint32_t VERSION = 1;
+
+    /**
+     * Checks if the context can save and load program binaries (OpenGL 4.1 or ARB_get_program_binary,
+     * with at least one binary format).
+     */
+    static bool isSupported() {
+        if (!GLAD_GL_VERSION_4_1 && !glProgramBinary)
+            return false;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    /**
+     * Builds the key of a program from the source of its stages and the driver that compiles it.
+     * Must be called on the GL thread.
+     */
+    static uint64_t makeKey(const std::vector<std::string>& sources) {
+        uint64_t key = FileCache::hash(&VERSION, sizeof(VERSION));
+        for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+            const char* text = reinterpret_cast<const char*>(glGetString(name));
+            key = FileCache::hash(text ? std::string(text) : std::string(), key);
+        }
+        for (const std::string& source : sources) {
+            // the length keeps "ab" + "c" and "a" + "bc" apart
+            uint64_t length = source.size();
+            key = FileCache::hash(&length, sizeof(length), key);
+            key = FileCache::hash(source, key);
+        }
+        return key;
+    }
+
+    /**
+     * Loads the cached binary of a program into a program object. Returns false if there is no binary for the key
+     * or the driver rejected it, in which case the program has to be linked from source; the caller should use a fresh
+     * program object for that, since a failed glProgramBinary leaves the program in an unlinked state.
+     */
+    static bool load(GLuint program, uint64_t key) {
+        TRACE_SCOPE("io", "ProgramCache::load");
+        if (!isSupported())
+            return false;
+        std::string path = cachePath(key);
+        MappedFile file;
+        if (!file.open(path) || file.size() < sizeof(ProgramCacheHeader)) {
+            misses++;
+            return false;
+        }
+        ProgramCacheHeader header;
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (std::memcmp(header.magic, MAGIC, sizeof(header.magic)) != 0 || header.version != VERSION || header.key != key ||
+            sizeof(header) + (size_t)header.binaryLength != file.size()) {
+            misses++;
+            return false;
+        }
+        glProgramBinary(program, header.binaryFormat, file.data() + sizeof(header), (GLsizei)header.binaryLength);
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            // the driver no longer accepts it; the program will be compiled and saved again
+            rejected++;
+            return false;
+        }
+        hits++;
+        return true;
+    }
+
+    /**
+     * Saves the binary of a linked program. The program should have been linked with
+     * GL_PROGRAM_BINARY_RETRIEVABLE_HINT set, see prepare(). Returns false on failure.
+     */
+    static bool save(GLuint program, uint64_t key) {
+        TRACE_SCOPE("io", "ProgramCache::save");
+        if (!isSupported())
+            return false;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return false;
+        std::vector<char> data(sizeof(ProgramCacheHeader) + (size_t)length);
+        GLenum format = 0;
+        GLsizei written = 0;
+        glGetProgramBinary(program, length, &written, &format, &data[sizeof(ProgramCacheHeader)]);
+        if (written <= 0)
+            return false;
+        data.resize(sizeof(ProgramCacheHeader) + (size_t)written);
+        ProgramCacheHeader header;
+        std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+        header.version = VERSION;
+        header.key = key;
+        header.binaryFormat = format;
+        header.binaryLength = (uint32_t)written;
+        std::memcpy(&data[0], &header, sizeof(header));
+        return FileCache::writeFile(cachePath(key), data);
+    }
+
+    /**
+     * Asks the driver to keep the binary of a program retrievable. Call before glLinkProgram.
+     */
+    static void prepare(GLuint program) {
+        if (isSupported())
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    /**
+     * Gets the number of programs loaded from the cache, not found in it, and rejected by the driver since startup.
+     */
+    static unsigned int getHits() {
+        return hits;
+    }
+
+    static unsigned int getMisses() {
+        return misses;
+    }
+
+    static unsigned int getRejected() {
+        return rejected;
+    }
+
+private:
+    static constexpr const char* MAGIC = "FSPB";
+
+    struct ProgramCacheHeader {
+        char     magic[4];
+        uint32_t version;
+        uint64_t key;
+        uint32_t binaryFormat;
+        uint32_t binaryLength;
+    };
+
+    static inline std::atomic<unsigned int> hits{ 0 }, misses{ 0 }, rejected{ 0 };
+
+    static std::string cachePath(uint64_t key) {
+        return FileCache::cacheFilePath("shaders", key, ".pcache");
+    }
+};
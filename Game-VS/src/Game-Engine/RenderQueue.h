@@ -0,0 +1,204 @@
+#pragma once
+#include <glad.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <utility>
+#include <vector>
+#include "Shader.h"
+#include "Mesh.h"
+#include "UniformBuffers.h"
+
+/**
+ * Passes of a frame, drawn in this order. Opaque items are sorted by state and then front to back,
+ * transparent ones back to front.
+ */
+enum RenderPass {
+    RENDER_PASS_OPAQUE = 0,
+    RENDER_PASS_TRANSPARENT
+};
+
+/**
+ * State changes done and avoided by a RenderQueue in the last frame.
+ */
+struct RenderStats {
+    unsigned int draws = 0;
+    unsigned int programBinds = 0, programBindsSkipped = 0;
+    unsigned int transformBlockBinds = 0, transformBlockBindsSkipped = 0; // blocks of model matrices, see UniformBuffers
+    unsigned int transformIndexUploads = 0, transformIndexUploadsSkipped = 0; // shared by the meshes of an object
+    unsigned int materialBinds = 0, materialBindsSkipped = 0;
+    unsigned int vertexArrayBinds = 0, vertexArrayBindsSkipped = 0;
+};
+
+/**
+ * Collects the mesh draws of a frame, sorts them by a packed 64 bit key and submits them, skipping every program,
+ * transform, material and vertex array change that would set the state already set. The model matrices of the frame
+ * are uploaded at once into the UniformBuffers, so a draw at most sets the index of its matrix; the programs read the
+ * camera from the Camera block, which the caller uploads once per frame.
+ *
+ * Key layout, from the most significant bit: pass (2 bits) | program (10) | material (20) | vertex array (16) | depth (16).
+ * Transparent items put the inverted depth right after the pass instead, so they are drawn back to front.
+ * The ids are truncated to their fields, so two unrelated ids may sort together; this only costs a state change,
+ * since submit() compares the actual state.
+ */
+class RenderQueue {
+public:
+    /**
+     * @param maxDepth distance from the camera that maps to the largest depth in the key, e.g. the far plane
+     */
+    explicit RenderQueue(float maxDepth = 100.0f) : maxDepth(maxDepth) {}
+
+    RenderQueue(const RenderQueue&) = delete;
+    RenderQueue& operator=(const RenderQueue&) = delete;
+
+    /**
+     * Starts collecting the draws of a frame seen from a camera position.
+     */
+    void begin(const glm::vec3& cameraPosition) {
+        this->cameraPosition = cameraPosition;
+        items.clear();
+        transforms.clear();
+    }
+
+    /**
+     * Adds a model matrix shared by the draws of an object, returning its index for add(). The shaders of the draws
+     * read it from the Transforms block, at the transformIndex uniform.
+     */
+    uint32_t addTransform(const glm::mat4& model) {
+        transforms.push_back(model);
+        return (uint32_t)transforms.size() - 1;
+    }
+
+    /**
+     * Adds the draw of a mesh.
+     * @param transform index of the model matrix, from addTransform()
+     * @param position world position the depth is measured from, usually the object's
+     */
+    void add(RenderPass pass, Shader* shader, Mesh* mesh, unsigned int lod, uint32_t transform, const glm::vec3& position) {
+        const std::vector<MaterialBinding>& bindings = mesh->getMaterialBindings(*shader);
+        uint64_t material = bindings.empty() ? 0 : bindings[0].texture;
+        float distance = glm::length(position - cameraPosition) / maxDepth;
+        uint64_t depth = (uint64_t)(std::min(std::max(distance, 0.0f), 1.0f) * 65535.0f);
+        DrawItem item;
+        item.key = makeKey(pass, shader->ID, material, mesh->VAO.get(), depth);
+        item.shader = shader;
+        item.mesh = mesh;
+        item.lod = lod;
+        item.transform = transform;
+        items.push_back(item);
+    }
+
+    /**
+     * Uploads the model matrices, then sorts and draws the collected items.
+     */
+    void submit() {
+        stats = RenderStats();
+        order.clear();
+        for (uint32_t i = 0; i < items.size(); i++)
+            order.emplace_back(items[i].key, i);
+        std::sort(order.begin(), order.end());
+
+        UniformBuffers& uniforms = UniformBuffers::instance();
+        uniforms.setTransforms(transforms);
+        unsigned int transformBlock = 0;
+        const Shader* program = nullptr;
+        const std::vector<MaterialBinding>* material = nullptr;
+        unsigned int vertexArray = 0;
+        int transformIndex = -1;
+        for (const auto& entry : order) {
+            const DrawItem& item = items[entry.second];
+            if (item.shader != program) {
+                item.shader->use();
+                program = item.shader;
+                // the transform index and texture layers were set in the previous program
+                material = nullptr;
+                transformIndex = -1;
+                stats.programBinds++;
+            }
+            else
+                stats.programBindsSkipped++;
+
+            unsigned int block = UniformBuffers::getTransformBlock(item.transform);
+            if (block != transformBlock) {
+                uniforms.bindTransformBlock(block);
+                transformBlock = block;
+                stats.transformBlockBinds++;
+            }
+            else
+                stats.transformBlockBindsSkipped++;
+
+            int index = UniformBuffers::getTransformIndex(item.transform);
+            if (index != transformIndex) {
+                item.shader->setInt(UNIFORM_TRANSFORM_INDEX, index);
+                transformIndex = index;
+                stats.transformIndexUploads++;
+            }
+            else
+                stats.transformIndexUploadsSkipped++;
+
+            const std::vector<MaterialBinding>& bindings = item.mesh->getMaterialBindings(*item.shader);
+            if (material && *material == bindings)
+                stats.materialBindsSkipped++;
+            else {
+                for (const MaterialBinding& binding : bindings)
+                    ApplyMaterialBinding(binding);
+                material = &bindings;
+                stats.materialBinds++;
+            }
+
+            if (item.mesh->VAO.get() != vertexArray) {
+                vertexArray = item.mesh->VAO.get();
+                glBindVertexArray(vertexArray);
+                stats.vertexArrayBinds++;
+            }
+            else
+                stats.vertexArrayBindsSkipped++;
+
+            item.mesh->drawElements(item.lod);
+            stats.draws++;
+        }
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    /**
+     * Gets the state changes done and avoided by the last submit().
+     */
+    const RenderStats& getStats() const {
+        return stats;
+    }
+
+    void printStats() const {
+        std::cout << "Render queue: " << stats.draws << " draws, "
+                  << stats.programBinds << " program binds (" << stats.programBindsSkipped << " avoided), "
+                  << stats.transformBlockBinds << " transform block binds (" << stats.transformBlockBindsSkipped << " avoided), "
+                  << stats.transformIndexUploads << " transform index uploads (" << stats.transformIndexUploadsSkipped << " avoided), "
+                  << stats.materialBinds << " material binds (" << stats.materialBindsSkipped << " avoided), "
+                  << stats.vertexArrayBinds << " vertex array binds (" << stats.vertexArrayBindsSkipped << " avoided)\n";
+    }
+
+private:
+    struct DrawItem {
+        uint64_t key;
+        Shader* shader;
+        Mesh* mesh;
+        unsigned int lod;
+        uint32_t transform;
+    };
+
+    float maxDepth;
+    glm::vec3 cameraPosition = glm::vec3(0.0f);
+    std::vector<DrawItem> items;
+    std::vector<glm::mat4> transforms;
+    // sorted (key, item index) pairs, so the items themselves aren't moved
+    std::vector<std::pair<uint64_t, uint32_t>> order;
+    RenderStats stats;
+
+    static uint64_t makeKey(RenderPass pass, uint64_t program, uint64_t material, uint64_t vertexArray, uint64_t depth) {
+        uint64_t key = (uint64_t)pass << 62;
+        if (pass == RENDER_PASS_TRANSPARENT)
+            return key | ((0xFFFF - depth) << 46) | ((program & 0x3FF) << 36) | ((material & 0xFFFFF) << 16) | (vertexArray & 0xFFFF);
+        return key | ((program & 0x3FF) << 52) | ((material & 0xFFFFF) << 32) | ((vertexArray & 0xFFFF) << 16) | depth;
+    }
+};
@@ -0,0 +1,501 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include "FileCache.h"
+#include "MappedFile.h"
+#include "Trace.h"
+
+/**
+ * Kind of game object a scene object is instantiated as.
+ */
+enum SceneObjectType {
+    SCENE_OBJECT_STATIC = 0, // plain GameObject
+    SCENE_OBJECT_BIRD,
+    SCENE_OBJECT_HARP,
+    SCENE_OBJECT_NPC,
+    SCENE_OBJECT_COIN
+};
+
+/**
+ * Flags of a scene object.
+ */
+enum SceneObjectFlags {
+    SCENE_OBJECT_IMPOSTOR = 1 << 0 // drawn as an impostor when far away
+};
+
+/**
+ * Model used by the objects of a scene. Its objects are stored next to each other, so all instances of a model
+ * are created in one go.
+ */
+struct SceneAsset {
+    uint32_t pathOffset;  // in the string table
+    uint32_t firstObject; // index of its first object
+    uint32_t objectCount;
+};
+
+/**
+ * Placement of one game object. Translation and scale are in scene units, before the scene's global scales.
+ */
+struct SceneObject {
+    glm::vec3 translation;
+    glm::vec3 scale;
+    glm::vec3 rotation;     // euler angles, in degrees
+    float colliderRadius;   // radius of the sphere collider of NPCs and coins
+    uint32_t asset;         // index of its SceneAsset
+    uint32_t type;          // SceneObjectType
+    uint32_t flags;         // SceneObjectFlags
+};
+
+/**
+ * Sound played at a place in the scene.
+ */
+struct SceneEmitter {
+    uint32_t nameOffset;    // in the string table
+    uint32_t pathOffset;    // in the string table
+    float volume;
+    float reverb;
+    uint32_t loop;          // 1 if the sound loops, 0 if played once
+    uint32_t positional;    // 1 for a 3D sound, 0 for a 2D one
+    glm::vec3 position;     // in scene units, before the scene's position scale
+};
+
+/**
+ * Placement of every object and sound emitter of a level: its asset table, object transforms and colliders,
+ * sound emitters, and global settings.
+ *
+ * Scenes are written in a line based text format (see res/scenes/), which is compiled on first use into a binary
+ * file under res/cache/scenes/. Later runs map the binary file and read the records from it as they are, so loading
+ * a scene is one mapping and a few bounds checks. Objects are sorted by asset, keeping their order in the source
+ * within each asset. The binary file is rebuilt whenever the text changes.
+ *
+ * Text format, one statement per line, # starts a comment, paths are quoted:
+ *   global_scale <s>                  scale of every object
+ *   position_scale <s>                scale of every object and emitter position
+ *   player_start <x y z>
+ *   asset <name> "<path>"
+ *   object <static|bird|harp|npc|coin> <asset> [position <x y z>] [scale <s>|<x y z>] [rotation <x y z>] [collider <r>] [impostor]
+ *   emitter <name> "<path>" [position <x y z>] [volume <v>] [reverb <r>] [loop|once] [3d|2d]
+ *
+ * Binary layout (little endian):
+ *   SceneHeader | source path (padded to 8) | SceneAsset[assetCount] | SceneObject[objectCount] | SceneEmitter[emitterCount] | strings
+ */
+class SceneFile {
+public:
+    // bump whenever the binary layout changes so that stale files are recompiled
+    static const uint32_t VERSION = 1;
+
+    SceneFile() {}
+    SceneFile(const SceneFile&) = delete;
+    SceneFile& operator=(const SceneFile&) = delete;
+
+    /**
+     * Loads a scene from its text source, through its compiled binary file when that is up to date.
+     * Returns false if the source can't be read or has an error, with the reason in error if provided.
+     */
+    bool load(const std::string& sourcePath, std::string* error = nullptr) {
+        TRACE_SCOPE("io", "SceneFile::load", sourcePath);
+        close();
+        SourceFileStamp source = FileCache::stamp(sourcePath);
+        if (!source.exists)
+            return fail(error, "can't read " + sourcePath);
+        std::string binaryPath = cachePath(sourcePath);
+        if (file.open(binaryPath) && parse(file.data(), file.size(), sourcePath, source)) {
+            compiled = false;
+            return true;
+        }
+        file.close();
+
+        std::vector<char> data;
+        if (!compile(sourcePath, source, data, error))
+            return false;
+        // the compiled file is used from memory if it can't be written, and mapped from the next run on
+        if (!FileCache::writeFile(binaryPath, data))
+            std::cout << "Scene: can't write " << binaryPath << "\n";
+        compiledData = std::move(data);
+        if (!parse(reinterpret_cast<const unsigned char*>(compiledData.data()), compiledData.size(), sourcePath, source)) {
+            close();
+            return fail(error, "compiled scene is invalid");
+        }
+        compiled = true;
+        return true;
+    }
+
+    void close() {
+        file.close();
+        compiledData.clear();
+        header = SceneHeader();
+        assets = nullptr;
+        objects = nullptr;
+        emitters = nullptr;
+        strings = nullptr;
+    }
+
+    /**
+     * Returns true if the scene was compiled from its text by the last load, false if its binary file was mapped.
+     */
+    bool wasCompiled() const {
+        return compiled;
+    }
+
+    uint32_t getAssetCount() const {
+        return header.assetCount;
+    }
+
+    const SceneAsset& getAsset(uint32_t index) const {
+        return assets[index];
+    }
+
+    uint32_t getObjectCount() const {
+        return header.objectCount;
+    }
+
+    const SceneObject& getObject(uint32_t index) const {
+        return objects[index];
+    }
+
+    uint32_t getEmitterCount() const {
+        return header.emitterCount;
+    }
+
+    const SceneEmitter& getEmitter(uint32_t index) const {
+        return emitters[index];
+    }
+
+    /**
+     * Gets a string of the string table. It stays valid as long as the scene is loaded, so it can be handed
+     * to objects that keep the pointer, like GameObject and SoundInfo.
+     */
+    const char* getString(uint32_t offset) const {
+        return strings + offset;
+    }
+
+    glm::vec3 getGlobalScale() const {
+        return header.globalScale;
+    }
+
+    glm::vec3 getPositionScale() const {
+        return header.positionScale;
+    }
+
+    glm::vec3 getPlayerStart() const {
+        return header.playerStart;
+    }
+
+    /**
+     * Finds an emitter by name. Returns nullptr if the scene has none with that name.
+     */
+    const SceneEmitter* findEmitter(const char* name) const {
+        for (uint32_t i = 0; i < header.emitterCount; i++)
+            if (std::strcmp(getString(emitters[i].nameOffset), name) == 0)
+                return &emitters[i];
+        return nullptr;
+    }
+
+private:
+    static constexpr const char* MAGIC = "FSSC";
+
+    struct SceneHeader {
+        char      magic[4] = {};
+        uint32_t  version = 0;
+        uint64_t  sourceModifiedTime = 0;
+        uint64_t  sourceSize = 0;
+        uint32_t  sourcePathLength = 0;
+        uint32_t  assetCount = 0;
+        uint32_t  objectCount = 0;
+        uint32_t  emitterCount = 0;
+        uint32_t  stringsSize = 0;
+        glm::vec3 globalScale = glm::vec3(1.0f);
+        glm::vec3 positionScale = glm::vec3(1.0f);
+        glm::vec3 playerStart = glm::vec3(0.0f);
+    };
+
+    MappedFile file;
+    std::vector<char> compiledData; // the compiled file, when it wasn't mapped
+    SceneHeader header;
+    const SceneAsset* assets = nullptr;
+    const SceneObject* objects = nullptr;
+    const SceneEmitter* emitters = nullptr;
+    const char* strings = nullptr;
+    bool compiled = false;
+
+    static std::string cachePath(const std::string& sourcePath) {
+        return FileCache::cacheFilePath("scenes", FileCache::hash(sourcePath), ".scache");
+    }
+
+    static bool fail(std::string* error, const std::string& message) {
+        if (error)
+            *error = message;
+        return false;
+    }
+
+    /**
+     * Validates a compiled scene against its source and points the record arrays into it. Every offset is bounds
+     * checked, since the cache directory may contain files written by an older or interrupted run.
+     */
+    bool parse(const unsigned char* base, size_t size, const std::string& sourcePath, const SourceFileStamp& source) {
+        if (size < sizeof(SceneHeader))
+            return false;
+        SceneHeader read;
+        std::memcpy(&read, base, sizeof(read));
+        if (std::memcmp(read.magic, MAGIC, sizeof(read.magic)) != 0 || read.version != VERSION ||
+            read.sourceModifiedTime != source.modifiedTime || read.sourceSize != source.size ||
+            read.sourcePathLength != sourcePath.size())
+            return false;
+        if (size < sizeof(read) + sourcePath.size() || std::memcmp(base + sizeof(read), sourcePath.data(), sourcePath.size()) != 0)
+            return false;
+        size_t assetsOffset = sizeof(SceneHeader) + FileCache::align(sourcePath.size(), 8);
+        size_t objectsOffset = assetsOffset + (size_t)read.assetCount * sizeof(SceneAsset);
+        size_t emittersOffset = objectsOffset + (size_t)read.objectCount * sizeof(SceneObject);
+        size_t stringsOffset = emittersOffset + (size_t)read.emitterCount * sizeof(SceneEmitter);
+        if (stringsOffset + read.stringsSize != size || read.stringsSize == 0 || base[size - 1] != '\0')
+            return false;
+
+        const SceneAsset* readAssets = reinterpret_cast<const SceneAsset*>(base + assetsOffset);
+        const SceneObject* readObjects = reinterpret_cast<const SceneObject*>(base + objectsOffset);
+        const SceneEmitter* readEmitters = reinterpret_cast<const SceneEmitter*>(base + emittersOffset);
+        for (uint32_t i = 0; i < read.assetCount; i++) {
+            const SceneAsset& asset = readAssets[i];
+            if (asset.pathOffset >= read.stringsSize || asset.firstObject > read.objectCount ||
+                asset.objectCount > read.objectCount - asset.firstObject)
+                return false;
+        }
+        for (uint32_t i = 0; i < read.objectCount; i++)
+            if (readObjects[i].asset >= read.assetCount || readObjects[i].type > SCENE_OBJECT_COIN)
+                return false;
+        for (uint32_t i = 0; i < read.emitterCount; i++)
+            if (readEmitters[i].nameOffset >= read.stringsSize || readEmitters[i].pathOffset >= read.stringsSize)
+                return false;
+
+        header = read;
+        assets = readAssets;
+        objects = readObjects;
+        emitters = readEmitters;
+        strings = reinterpret_cast<const char*>(base + stringsOffset);
+        return true;
+    }
+
+    // splits a line into words, keeping quoted text together and dropping comments
+    static bool tokenize(const std::string& line, std::vector<std::string>& tokens) {
+        tokens.clear();
+        size_t i = 0;
+        while (i < line.size()) {
+            char c = line[i];
+            if (c == ' ' || c == '\t' || c == '\r') {
+                i++;
+            }
+            else if (c == '#') {
+                break;
+            }
+            else if (c == '"') {
+                size_t end = line.find('"', i + 1);
+                if (end == std::string::npos)
+                    return false;
+                tokens.push_back(line.substr(i + 1, end - i - 1));
+                i = end + 1;
+            }
+            else {
+                size_t end = line.find_first_of(" \t\r#", i);
+                if (end == std::string::npos)
+                    end = line.size();
+                tokens.push_back(line.substr(i, end - i));
+                i = end;
+            }
+        }
+        return true;
+    }
+
+    static bool parseNumber(const std::string& token, float& value) {
+        if (token.empty())
+            return false;
+        char* end = nullptr;
+        value = std::strtof(token.c_str(), &end);
+        return end == token.c_str() + token.size();
+    }
+
+    // reads the numbers following the keyword at tokens[i], advancing i past them
+    static bool parseVector(const std::vector<std::string>& tokens, size_t& i, glm::vec3& value) {
+        if (i + 3 >= tokens.size() || !parseNumber(tokens[i + 1], value.x) || !parseNumber(tokens[i + 2], value.y) ||
+            !parseNumber(tokens[i + 3], value.z))
+            return false;
+        i += 4;
+        return true;
+    }
+
+    static bool parseScalar(const std::vector<std::string>& tokens, size_t& i, float& value) {
+        if (i + 1 >= tokens.size() || !parseNumber(tokens[i + 1], value))
+            return false;
+        i += 2;
+        return true;
+    }
+
+    // scales are either uniform or per axis
+    static bool parseScale(const std::vector<std::string>& tokens, size_t& i, glm::vec3& value) {
+        if (parseVector(tokens, i, value))
+            return true;
+        float uniform;
+        if (!parseScalar(tokens, i, uniform))
+            return false;
+        value = glm::vec3(uniform);
+        return true;
+    }
+
+    /**
+     * Compiles the text source of a scene into the binary layout.
+     */
+    static bool compile(const std::string& sourcePath, const SourceFileStamp& source, std::vector<char>& data, std::string* error) {
+        TRACE_SCOPE("import", "SceneFile::compile", sourcePath);
+        std::ifstream in(sourcePath);
+        if (!in)
+            return fail(error, "can't read " + sourcePath);
+
+        SceneHeader out;
+        std::memcpy(out.magic, MAGIC, sizeof(out.magic));
+        out.version = VERSION;
+        out.sourceModifiedTime = source.modifiedTime;
+        out.sourceSize = source.size;
+        out.sourcePathLength = (uint32_t)sourcePath.size();
+
+        std::string stringTable;
+        std::unordered_map<std::string, uint32_t> stringOffsets;
+        auto addString = [&](const std::string& text) {
+            auto found = stringOffsets.find(text);
+            if (found != stringOffsets.end())
+                return found->second;
+            uint32_t offset = (uint32_t)stringTable.size();
+            stringTable.append(text).push_back('\0');
+            stringOffsets.emplace(text, offset);
+            return offset;
+        };
+
+        std::vector<SceneAsset> assetTable;
+        std::unordered_map<std::string, uint32_t> assetIndices;
+        std::vector<SceneObject> objectTable;
+        std::vector<SceneEmitter> emitterTable;
+        std::vector<std::string> tokens;
+        std::string line;
+        for (unsigned int lineNumber = 1; std::getline(in, line); lineNumber++) {
+            std::string at = sourcePath + ":" + std::to_string(lineNumber) + ": ";
+            if (!tokenize(line, tokens))
+                return fail(error, at + "unterminated quote");
+            if (tokens.empty())
+                continue;
+            const std::string& statement = tokens[0];
+            size_t i = 0;
+            if (statement == "global_scale" || statement == "position_scale" || statement == "player_start") {
+                glm::vec3& value = statement == "global_scale" ? out.globalScale :
+                                   statement == "position_scale" ? out.positionScale : out.playerStart;
+                bool valid = statement == "player_start" ? parseVector(tokens, i, value) : parseScale(tokens, i, value);
+                if (!valid || i != tokens.size())
+                    return fail(error, at + "expected " + statement + " and its value");
+            }
+            else if (statement == "asset") {
+                if (tokens.size() != 3)
+                    return fail(error, at + "expected asset <name> \"<path>\"");
+                if (!assetIndices.emplace(tokens[1], (uint32_t)assetTable.size()).second)
+                    return fail(error, at + "asset " + tokens[1] + " is already defined");
+                SceneAsset asset = {};
+                asset.pathOffset = addString(tokens[2]);
+                assetTable.push_back(asset);
+            }
+            else if (statement == "object") {
+                static const char* const TYPE_NAMES[] = { "static", "bird", "harp", "npc", "coin" };
+                if (tokens.size() < 3)
+                    return fail(error, at + "expected object <type> <asset>");
+                SceneObject object = {};
+                object.scale = glm::vec3(1.0f);
+                const char* const* type = std::find(std::begin(TYPE_NAMES), std::end(TYPE_NAMES), tokens[1]);
+                if (type == std::end(TYPE_NAMES))
+                    return fail(error, at + "unknown object type " + tokens[1]);
+                object.type = (uint32_t)(type - std::begin(TYPE_NAMES));
+                auto asset = assetIndices.find(tokens[2]);
+                if (asset == assetIndices.end())
+                    return fail(error, at + "unknown asset " + tokens[2]);
+                object.asset = asset->second;
+                for (i = 3; i < tokens.size();) {
+                    bool valid = true;
+                    if (tokens[i] == "position")
+                        valid = parseVector(tokens, i, object.translation);
+                    else if (tokens[i] == "scale")
+                        valid = parseScale(tokens, i, object.scale);
+                    else if (tokens[i] == "rotation")
+                        valid = parseVector(tokens, i, object.rotation);
+                    else if (tokens[i] == "collider")
+                        valid = parseScalar(tokens, i, object.colliderRadius);
+                    else if (tokens[i] == "impostor") {
+                        object.flags |= SCENE_OBJECT_IMPOSTOR;
+                        i++;
+                    }
+                    else
+                        return fail(error, at + "unknown object property " + tokens[i]);
+                    if (!valid)
+                        return fail(error, at + "expected numbers after " + tokens[i]);
+                }
+                objectTable.push_back(object);
+            }
+            else if (statement == "emitter") {
+                if (tokens.size() < 3)
+                    return fail(error, at + "expected emitter <name> \"<path>\"");
+                SceneEmitter emitter = {};
+                emitter.nameOffset = addString(tokens[1]);
+                emitter.pathOffset = addString(tokens[2]);
+                emitter.volume = 1.0f;
+                for (i = 3; i < tokens.size();) {
+                    bool valid = true;
+                    if (tokens[i] == "position")
+                        valid = parseVector(tokens, i, emitter.position);
+                    else if (tokens[i] == "volume")
+                        valid = parseScalar(tokens, i, emitter.volume);
+                    else if (tokens[i] == "reverb")
+                        valid = parseScalar(tokens, i, emitter.reverb);
+                    else if (tokens[i] == "loop" || tokens[i] == "once")
+                        emitter.loop = tokens[i++] == "loop";
+                    else if (tokens[i] == "3d" || tokens[i] == "2d")
+                        emitter.positional = tokens[i++] == "3d";
+                    else
+                        return fail(error, at + "unknown emitter property " + tokens[i]);
+                    if (!valid)
+                        return fail(error, at + "expected numbers after " + tokens[i]);
+                }
+                emitterTable.push_back(emitter);
+            }
+            else
+                return fail(error, at + "unknown statement " + statement);
+        }
+
+        // the objects of an asset are stored together, in the order they were written
+        std::stable_sort(objectTable.begin(), objectTable.end(),
+                         [](const SceneObject& a, const SceneObject& b) { return a.asset < b.asset; });
+        for (uint32_t i = 0; i < objectTable.size(); i++) {
+            SceneAsset& asset = assetTable[objectTable[i].asset];
+            if (asset.objectCount++ == 0)
+                asset.firstObject = i;
+        }
+        if (stringTable.empty())
+            stringTable.push_back('\0');
+
+        out.assetCount = (uint32_t)assetTable.size();
+        out.objectCount = (uint32_t)objectTable.size();
+        out.emitterCount = (uint32_t)emitterTable.size();
+        out.stringsSize = (uint32_t)stringTable.size();
+        size_t offset = sizeof(SceneHeader) + FileCache::align(sourcePath.size(), 8);
+        data.assign(offset, 0);
+        std::memcpy(&data[0], &out, sizeof(out));
+        std::memcpy(&data[sizeof(out)], sourcePath.data(), sourcePath.size());
+        auto append = [&data](const void* bytes, size_t size) {
+            data.insert(data.end(), static_cast<const char*>(bytes), static_cast<const char*>(bytes) + size);
+        };
+        append(assetTable.data(), assetTable.size() * sizeof(SceneAsset));
+        append(objectTable.data(), objectTable.size() * sizeof(SceneObject));
+        append(emitterTable.data(), emitterTable.size() * sizeof(SceneEmitter));
+        append(stringTable.data(), stringTable.size());
+        return true;
+    }
+};
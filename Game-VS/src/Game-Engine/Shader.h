@@ -2,22 +2,74 @@
 #include <glad.h>
 #include <glm/glm.hpp>
 #include <string>
+#include <set>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include "GpuResource.h"
+#include "ProgramCache.h"
+#include "Trace.h"
+
+/**
+ * 64 bit FNV-1a hash of a uniform name, the same function as FileCache::hash. Usable at compile time.
+ */
+constexpr uint64_t HashUniformName(const char* name) {
+    uint64_t hash = 14695981039346656037ull;
+    for (; *name; name++) {
+        hash ^= (unsigned char)*name;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * Name of a uniform, looked up by its hash in the uniform table of a Shader. Names given as string literals are
+ * hashed by the compiler when the UniformName is a constant (see UNIFORM_TRANSFORM_INDEX); others are hashed where they're used,
+ * which is still far cheaper than asking the driver with glGetUniformLocation.
+ */
+struct UniformName {
+    uint64_t hash;
+
+    constexpr UniformName(const char* name) : hash(HashUniformName(name)) {}
+    UniformName(const std::string& name) : hash(HashUniformName(name.c_str())) {}
+};
+
+// first texture unit of texture arrays: a material sampler's "<sampler>_array" twin gets TEXTURE_ARRAY_UNIT + its unit
+const unsigned int TEXTURE_ARRAY_UNIT = 8;
+// number of texture units from TEXTURE_ARRAY_UNIT on reserved for texture arrays
+const unsigned int MAX_TEXTURE_ARRAY_UNITS = 8;
+
+/**
+ * Binding points of the uniform blocks shared by every program, see UniformBuffers. Programs declaring a block
+ * of one of these names get it bound at link time.
+ */
+enum UniformBlockBinding {
+    UNIFORM_BLOCK_CAMERA = 0, // "Camera": projection, view and camera position of the frame
+    UNIFORM_BLOCK_TRANSFORMS  // "Transforms": model matrices of the objects drawn
+};
+
+// index of the model matrix of the object drawn in the Transforms block, the only uniform set for every object
+constexpr UniformName UNIFORM_TRANSFORM_INDEX("transformIndex");
+
 /**
  * Class that encapsulates the data and operations needed for an OpenGL shader
  * Source: https://learnopengl.com/Getting-started/Shaders
  */
 class Shader {
 public:
-    // Shader ID generated by glCreateProgram
+    // Shader ID generated by glCreateProgram, owned by program
     unsigned int ID;
     
     /**
-     * Constructs a shader object. Upon construction, all openGL setup
+     * Constructs a shader object. Upon construction, all openGL setup. The linked program is cached on disk by
+     * ProgramCache, so later runs skip compiling as long as the sources and the driver stay the same.
      */
     Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr) {
+        TRACE_SCOPE("shader", "Shader", fragmentPath);
         // Retrieve the vertex/fragment source code from provided paths
         std::string vertexCode;
         std::string fragmentCode;
@@ -54,43 +106,58 @@ public:
         } catch (std::ifstream::failure& e) {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
-        const char* vShaderCode = vertexCode.c_str();
-        const char* fShaderCode = fragmentCode.c_str();
-        // Compile shaders
-        unsigned int vertex, fragment;
-        // Vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // Fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // If provided, compile geometry shader
-        unsigned int geometry;
-        if (geometryPath != nullptr) {
-            const char* gShaderCode = geometryCode.c_str();
-            geometry = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometry, 1, &gShaderCode, NULL);
-            glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
+        // Load the linked program cached by an earlier run, and only compile the stages if there is none
+        uint64_t cacheKey = ProgramCache::makeKey({ vertexCode, fragmentCode, geometryCode });
+        program = GLProgram::create();
+        ID = program.get();
+        if (!ProgramCache::load(ID, cacheKey)) {
+            // a rejected binary leaves the program unusable for linking, so link into a new one
+            program = GLProgram::create();
+            ID = program.get();
+            compileAndLink(vertexCode, fragmentCode, geometryPath != nullptr ? &geometryCode : nullptr);
+            GLint linked = GL_FALSE;
+            glGetProgramiv(ID, GL_LINK_STATUS, &linked);
+            if (linked)
+                ProgramCache::save(ID, cacheKey);
         }
-        // Create the shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        if (geometryPath != nullptr)
-            glAttachShader(ID, geometry);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // Delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if (geometryPath != nullptr)
-            glDeleteShader(geometry);
+        // Find the locations of all uniforms, and which samplers survived linking, so models only load the textures this shader reads
+        reflectUniforms();
+        assignSamplerUnits();
+        bindUniformBlocks();
+    }
+
+    /**
+     * Gets the names of the sampler uniforms actually used by the linked program (e.g. "texture_diffuse1").
+     * Samplers that are declared but never read are optimized out by the driver and not included.
+     */
+    const std::set<std::string>& getSamplerNames() const {
+        return samplerNames;
+    }
+
+    /**
+     * Checks if the linked program reads the named sampler uniform.
+     */
+    bool usesSampler(const std::string& name) const {
+        return samplerNames.count(name) != 0;
+    }
 
+    /**
+     * Gets the location of an active uniform from the table built at link time, without asking the driver.
+     * Returns -1, which glUniform* ignores, for names the program doesn't have or that were optimized out.
+     */
+    GLint getUniformLocation(const UniformName& name) const {
+        auto found = std::lower_bound(uniformLocations.begin(), uniformLocations.end(), std::make_pair(name.hash, (GLint)-1));
+        return found != uniformLocations.end() && found->first == name.hash ? found->second : -1;
+    }
+
+    /**
+     * Gets the texture unit a sampler was given at link time, or -1 if the program doesn't read it.
+     * Samplers are given units in name order, and the "<sampler>_array" twin of a sampler gets TEXTURE_ARRAY_UNIT + its unit,
+     * so textures only need to be bound at these units, without setting any sampler uniform while drawing.
+     */
+    GLint getSamplerUnit(const UniformName& name) const {
+        auto found = std::lower_bound(samplerUnits.begin(), samplerUnits.end(), std::make_pair(name.hash, (GLint)-1));
+        return found != samplerUnits.end() && found->first == name.hash ? found->second : -1;
     }
 
     /**
@@ -103,65 +170,205 @@ public:
     /**
      * Utility functions to set uniform values used by the shader
      */
-    void setBool(const std::string& name, bool value) const
+    void setBool(const UniformName& name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        glUniform1i(getUniformLocation(name), (int)value);
     }
     // ------------------------------------------------------------------------
-    void setInt(const std::string& name, int value) const
+    void setInt(const UniformName& name, int value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1i(getUniformLocation(name), value);
     }
     // ------------------------------------------------------------------------
-    void setFloat(const std::string& name, float value) const
+    void setFloat(const UniformName& name, float value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1f(getUniformLocation(name), value);
     }
     // ------------------------------------------------------------------------
-    void setVec2(const std::string& name, const glm::vec2& value) const
+    void setVec2(const UniformName& name, const glm::vec2& value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform2fv(getUniformLocation(name), 1, &value[0]);
     }
-    void setVec2(const std::string& name, float x, float y) const
+    void setVec2(const UniformName& name, float x, float y) const
     {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+        glUniform2f(getUniformLocation(name), x, y);
     }
     // ------------------------------------------------------------------------
-    void setVec3(const std::string& name, const glm::vec3& value) const
+    void setVec3(const UniformName& name, const glm::vec3& value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform3fv(getUniformLocation(name), 1, &value[0]);
     }
-    void setVec3(const std::string& name, float x, float y, float z) const
+    void setVec3(const UniformName& name, float x, float y, float z) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        glUniform3f(getUniformLocation(name), x, y, z);
     }
     // ------------------------------------------------------------------------
-    void setVec4(const std::string& name, const glm::vec4& value) const
+    void setVec4(const UniformName& name, const glm::vec4& value) const
     {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        glUniform4fv(getUniformLocation(name), 1, &value[0]);
     }
-    void setVec4(const std::string& name, float x, float y, float z, float w)
+    void setVec4(const UniformName& name, float x, float y, float z, float w)
     {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+        glUniform4f(getUniformLocation(name), x, y, z, w);
     }
     // ------------------------------------------------------------------------
-    void setMat2(const std::string& name, const glm::mat2& mat) const
+    void setMat2(const UniformName& name, const glm::mat2& mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat3(const std::string& name, const glm::mat3& mat) const
+    void setMat3(const UniformName& name, const glm::mat3& mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat4(const std::string& name, const glm::mat4& mat) const
+    void setMat4(const UniformName& name, const glm::mat4& mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
-    
+    // deletes the program along with the shader
+    GLProgram program;
+    // Active sampler uniforms of the program, found by reflectUniforms()
+    std::set<std::string> samplerNames;
+    // Locations of the active uniforms by the hash of their name, sorted by hash
+    std::vector<std::pair<uint64_t, GLint>> uniformLocations;
+    // Texture units of the active samplers by the hash of their name, sorted by hash
+    std::vector<std::pair<uint64_t, GLint>> samplerUnits;
+
+    /**
+     * Compiles the stages of the program from source and links them into ID.
+     */
+    void compileAndLink(const std::string& vertexCode, const std::string& fragmentCode, const std::string* geometryCode) {
+        TRACE_SCOPE("shader", "Shader::compileAndLink");
+        const char* vShaderCode = vertexCode.c_str();
+        const char* fShaderCode = fragmentCode.c_str();
+        // Compile shaders
+        unsigned int vertex, fragment;
+        // Vertex shader
+        vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex, 1, &vShaderCode, NULL);
+        glCompileShader(vertex);
+        checkCompileErrors(vertex, "VERTEX");
+        // Fragment Shader
+        fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment, 1, &fShaderCode, NULL);
+        glCompileShader(fragment);
+        checkCompileErrors(fragment, "FRAGMENT");
+        // If provided, compile geometry shader
+        unsigned int geometry;
+        if (geometryCode != nullptr) {
+            const char* gShaderCode = geometryCode->c_str();
+            geometry = glCreateShader(GL_GEOMETRY_SHADER);
+            glShaderSource(geometry, 1, &gShaderCode, NULL);
+            glCompileShader(geometry);
+            checkCompileErrors(geometry, "GEOMETRY");
+        }
+        // Link the shader Program, keeping its binary retrievable for the program cache
+        glAttachShader(ID, vertex);
+        glAttachShader(ID, fragment);
+        if (geometryCode != nullptr)
+            glAttachShader(ID, geometry);
+        ProgramCache::prepare(ID);
+        glLinkProgram(ID);
+        checkCompileErrors(ID, "PROGRAM");
+        // Delete the shaders as they're linked into our program now and no longer necessery
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        if (geometryCode != nullptr)
+            glDeleteShader(geometry);
+    }
+
+    /**
+     * Queries the active uniforms of the linked program, recording the location of each (and of each element of arrays)
+     * by the hash of its name, and the names of the ones that are samplers.
+     */
+    void reflectUniforms() {
+        uniformLocations.clear();
+        samplerNames.clear();
+        GLint numUniforms = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &numUniforms);
+        for (GLint i = 0; i < numUniforms; i++) {
+            GLchar name[256];
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, (GLuint)i, sizeof(name), &length, &size, &type, name);
+            std::string uniformName(name, length);
+            // arrays are reported as "name[0]"
+            size_t bracket = uniformName.find('[');
+            if (bracket != std::string::npos)
+                uniformName.erase(bracket);
+            // uniforms in blocks have no location
+            GLint location = glGetUniformLocation(ID, uniformName.c_str());
+            if (location >= 0) {
+                uniformLocations.emplace_back(HashUniformName(uniformName.c_str()), location);
+                for (GLint element = 0; bracket != std::string::npos && element < size; element++) {
+                    std::string elementName = uniformName + "[" + std::to_string(element) + "]";
+                    uniformLocations.emplace_back(HashUniformName(elementName.c_str()), glGetUniformLocation(ID, elementName.c_str()));
+                }
+            }
+            switch (type) {
+            case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+            case GL_SAMPLER_2D_SHADOW: case GL_SAMPLER_1D_ARRAY: case GL_SAMPLER_2D_ARRAY:
+            case GL_SAMPLER_2D_MULTISAMPLE: case GL_SAMPLER_BUFFER: case GL_SAMPLER_2D_RECT:
+                samplerNames.insert(uniformName);
+                break;
+            default:
+                break;
+            }
+        }
+        std::sort(uniformLocations.begin(), uniformLocations.end());
+        for (size_t i = 1; i < uniformLocations.size(); i++)
+            if (uniformLocations[i].first == uniformLocations[i - 1].first && uniformLocations[i].second != uniformLocations[i - 1].second)
+                std::cout << "WARNING::SHADER::UNIFORM_NAME_HASH_COLLISION at location " << uniformLocations[i].second << std::endl;
+    }
+
+    /**
+     * Gives every active sampler its texture unit, see getSamplerUnit().
+     */
+    void assignSamplerUnits() {
+        samplerUnits.clear();
+        GLint previousProgram = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+        glUseProgram(ID);
+        GLint nextUnit = 0;
+        for (const std::string& name : samplerNames) {
+            const std::string suffix = "_array";
+            bool isArrayTwin = name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0 &&
+                               samplerNames.count(name.substr(0, name.size() - suffix.size()));
+            if (isArrayTwin)
+                continue;
+            // units from TEXTURE_ARRAY_UNIT on are kept for the arrays
+            GLint unit = nextUnit < (GLint)TEXTURE_ARRAY_UNIT ? nextUnit : nextUnit + MAX_TEXTURE_ARRAY_UNITS;
+            nextUnit++;
+            glUniform1i(getUniformLocation(name), unit);
+            samplerUnits.emplace_back(HashUniformName(name.c_str()), unit);
+            if (unit < (GLint)TEXTURE_ARRAY_UNIT && samplerNames.count(name + suffix)) {
+                glUniform1i(getUniformLocation(name + suffix), TEXTURE_ARRAY_UNIT + unit);
+                samplerUnits.emplace_back(HashUniformName((name + suffix).c_str()), TEXTURE_ARRAY_UNIT + unit);
+            }
+        }
+        glUseProgram(previousProgram);
+        std::sort(samplerUnits.begin(), samplerUnits.end());
+    }
+
+    /**
+     * Binds the shared uniform blocks the program declares to their binding points, see UniformBlockBinding.
+     */
+    void bindUniformBlocks() {
+        static const std::pair<const char*, GLuint> BLOCKS[] = {
+            { "Camera", UNIFORM_BLOCK_CAMERA },
+            { "Transforms", UNIFORM_BLOCK_TRANSFORMS }
+        };
+        for (const auto& block : BLOCKS) {
+            GLuint index = glGetUniformBlockIndex(ID, block.first);
+            if (index != GL_INVALID_INDEX)
+                glUniformBlockBinding(ID, index, block.second);
+        }
+    }
+
     /**
      * Utility function that checks shader compilation/linking errors.
      */
@@ -0,0 +1,12 @@
+#pragma once
+
+/**
+ * HAS_SSE is 1 when the target supports SSE, which is every x86 target VS builds for, and 0 otherwise.
+ * Code using SSE intrinsics checks it and keeps a scalar fallback for other targets.
+ */
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#include <xmmintrin.h>
+#define HAS_SSE 1
+#else
+#define HAS_SSE 0
+#endif
@@ -0,0 +1,232 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "MappedFile.h"
+#include "Simd.h"
+#include "VertexLayout.h"
+
+/**
+ * One facet of a binary STL file.
+ */
+struct StlTriangle {
+    glm::vec3 normal; // facet normal as stored in the file; may be zero
+    glm::vec3 vertices[3];
+};
+
+/**
+ * Zero-copy reader of binary STL files. The file is memory mapped and facets are decoded straight from the mapping
+ * on access, so opening a file costs nothing but the mapping, whatever its size.
+ *
+ * Layout: 80 byte header | uint32 triangle count | per triangle: normal, 3 vertices (12 floats), uint16 attribute.
+ * Records are 50 bytes, so they aren't aligned and are read with memcpy. ASCII STL files aren't supported.
+ */
+class StlFile {
+public:
+    static const size_t HEADER_SIZE = 84;
+    static const size_t RECORD_SIZE = 50;
+
+    /**
+     * Maps a binary STL file. Returns false if it can't be opened or its size doesn't match its triangle count
+     * (which is also how ASCII files, starting with "solid", are told apart).
+     */
+    bool open(const std::string& path) {
+        file.close();
+        triangleCount = 0;
+        if (!file.open(path) || file.size() < HEADER_SIZE)
+            return false;
+        uint32_t count;
+        std::memcpy(&count, file.data() + 80, sizeof(count));
+        if (file.size() != HEADER_SIZE + (size_t)count * RECORD_SIZE) {
+            file.close();
+            return false;
+        }
+        triangleCount = count;
+        return true;
+    }
+
+    bool isOpen() const {
+        return file.isOpen();
+    }
+
+    uint32_t getTriangleCount() const {
+        return triangleCount;
+    }
+
+    /**
+     * Decodes a facet from the mapped file.
+     */
+    StlTriangle getTriangle(size_t index) const {
+        static_assert(sizeof(StlTriangle) == 48, "StlTriangle is expected to match the 12 floats of a record");
+        StlTriangle triangle;
+        std::memcpy(&triangle, file.data() + HEADER_SIZE + index * RECORD_SIZE, sizeof(triangle));
+        return triangle;
+    }
+
+private:
+    MappedFile file;
+    uint32_t triangleCount = 0;
+};
+
+/**
+ * Streaming vertex welder: triangles are added one at a time, and corners with the same position share one vertex,
+ * found through an open addressing hash table of the positions seen so far. Positions are compared bitwise,
+ * with -0 and +0 treated as equal, which is how STL files repeat the corners shared between facets.
+ */
+class VertexWelder {
+public:
+    /**
+     * @param expectedVertices number of unique vertices expected, to size the table; it grows as needed
+     */
+    explicit VertexWelder(size_t expectedVertices = 0) {
+        size_t capacity = 16;
+        while (capacity * 3 < expectedVertices * 4)
+            capacity *= 2;
+        slots.assign(capacity, Slot());
+        positions.reserve(expectedVertices);
+    }
+
+    /**
+     * Gets the index of the vertex at a position, adding a vertex if there is none there yet.
+     */
+    uint32_t addVertex(glm::vec3 position) {
+        // -0 and +0 compare equal as floats but not bitwise
+        position += glm::vec3(0.0f);
+        if ((positions.size() + 1) * 4 > slots.size() * 3)
+            grow();
+        size_t mask = slots.size() - 1;
+        size_t slot = hash(position) & mask;
+        while (slots[slot].index != EMPTY) {
+            if (std::memcmp(&slots[slot].position, &position, sizeof(glm::vec3)) == 0)
+                return slots[slot].index;
+            slot = (slot + 1) & mask;
+        }
+        slots[slot].position = position;
+        slots[slot].index = (uint32_t)positions.size();
+        positions.push_back(position);
+        return slots[slot].index;
+    }
+
+    /**
+     * Hints that a position is about to be added, so its slot in the table is fetched into the cache in the meantime.
+     * Does nothing where SSE isn't available.
+     */
+    void prefetch(glm::vec3 position) const {
+#if HAS_SSE
+        position += glm::vec3(0.0f);
+        _mm_prefetch((const char*)&slots[hash(position) & (slots.size() - 1)], _MM_HINT_T0);
+#else
+        (void)position;
+#endif
+    }
+
+    /**
+     * Adds a triangle, appending the indices of its corners.
+     */
+    void addTriangle(const glm::vec3* corners) {
+        for (int i = 0; i < 3; i++)
+            indices.push_back(addVertex(corners[i]));
+    }
+
+    const std::vector<glm::vec3>& getPositions() const {
+        return positions;
+    }
+
+    const std::vector<uint32_t>& getIndices() const {
+        return indices;
+    }
+
+private:
+    static constexpr uint32_t EMPTY = ~0u;
+
+    // the position is kept next to its index so a probe touches a single cache line
+    struct Slot {
+        glm::vec3 position = glm::vec3(0.0f);
+        uint32_t index = EMPTY;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+
+    static size_t hash(const glm::vec3& position) {
+        uint32_t bits[3];
+        std::memcpy(bits, &position, sizeof(bits));
+        uint64_t h = bits[0] * 0x9E3779B97F4A7C15ull;
+        h ^= bits[1] * 0xC2B2AE3D27D4EB4Full + (h >> 29);
+        h ^= bits[2] * 0x165667B19E3779F9ull + (h >> 32);
+        return (size_t)(h ^ (h >> 31));
+    }
+
+    void grow() {
+        slots.assign(slots.size() * 2, Slot());
+        size_t mask = slots.size() - 1;
+        for (uint32_t i = 0; i < positions.size(); i++) {
+            size_t slot = hash(positions[i]) & mask;
+            while (slots[slot].index != EMPTY)
+                slot = (slot + 1) & mask;
+            slots[slot].position = positions[i];
+            slots[slot].index = i;
+        }
+    }
+};
+
+/**
+ * Reads a binary STL file into an indexed mesh. Facets whose winding disagrees with their stored normal are flipped.
+ * Welded vertices get the area weighted average of their facets' normals; unwelded ones get their facet's normal.
+ * STL files have no texture coordinates, so those, and the tangents, are zero. Returns false if the file can't be read.
+ * @param weld if true, corners at the same position share a vertex; otherwise every corner is its own vertex
+ */
+inline bool ReadStlMesh(const std::string& path, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, bool weld = true) {
+    StlFile file;
+    if (!file.open(path))
+        return false;
+    uint32_t triangleCount = file.getTriangleCount();
+    std::vector<glm::vec3> faceNormals(triangleCount);
+    // a closed surface has about half as many vertices as triangles
+    VertexWelder welder(weld ? triangleCount / 2 : 0);
+    std::vector<glm::vec3> corners;
+    if (!weld)
+        corners.reserve((size_t)triangleCount * 3);
+    // large files have far more vertices than fit in the cache, so fetch the slots of a triangle ahead
+    const uint32_t PREFETCH_DISTANCE = 8;
+    for (uint32_t i = 0; i < triangleCount; i++) {
+        if (weld && i + PREFETCH_DISTANCE < triangleCount) {
+            StlTriangle ahead = file.getTriangle(i + PREFETCH_DISTANCE);
+            for (int corner = 0; corner < 3; corner++)
+                welder.prefetch(ahead.vertices[corner]);
+        }
+        StlTriangle triangle = file.getTriangle(i);
+        glm::vec3 normal = glm::cross(triangle.vertices[1] - triangle.vertices[0], triangle.vertices[2] - triangle.vertices[0]);
+        if (glm::dot(normal, triangle.normal) < 0.0f) {
+            std::swap(triangle.vertices[1], triangle.vertices[2]);
+            normal = -normal;
+        }
+        faceNormals[i] = normal;
+        if (weld)
+            welder.addTriangle(triangle.vertices);
+        else
+            corners.insert(corners.end(), triangle.vertices, triangle.vertices + 3);
+    }
+
+    const std::vector<glm::vec3>& positions = weld ? welder.getPositions() : corners;
+    vertices.assign(positions.size(), Vertex());
+    for (size_t i = 0; i < positions.size(); i++) {
+        vertices[i].Position = positions[i];
+        vertices[i].Normal = vertices[i].Tangent = vertices[i].Bitangent = glm::vec3(0.0f);
+        vertices[i].TexCoords = glm::vec2(0.0f);
+    }
+    indices.resize((size_t)triangleCount * 3);
+    for (size_t i = 0; i < indices.size(); i++) {
+        indices[i] = weld ? welder.getIndices()[i] : (unsigned int)i;
+        vertices[indices[i]].Normal += faceNormals[i / 3];
+    }
+    for (Vertex& vertex : vertices) {
+        float length = glm::length(vertex.Normal);
+        if (length > 0.0f)
+            vertex.Normal /= length;
+    }
+    return true;
+}
@@ -0,0 +1,241 @@
+#pragma once
+#include <glad.h>
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include "Model.h"
+#include "TextureCache.h"
+#include "TextureFile.h"
+#include "GpuResource.h"
+#include "Trace.h"
+
+/**
+ * Packs model textures of the same size, format and number of mipmaps into layers of GL_TEXTURE_2D_ARRAY textures.
+ * Each packed material texture becomes a layer index in an array (see Texture::array and Texture::layer), so meshes
+ * whose textures share an array draw without binding a texture at all once the array is bound, see ApplyMaterialBinding.
+ *
+ * Runs once every model and texture is loaded, since the layers are copied from the textures already on the GPU:
+ * with glCopyImageSubData on OpenGL 4.3, or through system memory otherwise. The copied textures are then released
+ * from the TextureCache so their memory isn't used twice. Must be called on the GL thread.
+ */
+class TextureArrayPacker {
+public:
+    // textures whose size and format no other texture shares stay plain 2D textures
+    static const unsigned int MIN_LAYERS = 2;
+
+    TextureArrayPacker() {}
+    TextureArrayPacker(const TextureArrayPacker&) = delete;
+    TextureArrayPacker& operator=(const TextureArrayPacker&) = delete;
+
+    /**
+     * Packs the textures of the models and points their meshes at the arrays. Textures that are already packed
+     * (by an earlier call) or not loaded are left alone.
+     * @param models every live model using the textures, so no mesh is left pointing at a released texture
+     * @param releaseSources if true, the packed textures are deleted through the TextureCache
+     * @return the number of textures packed
+     */
+    unsigned int pack(const std::vector<std::shared_ptr<Model>>& models, bool releaseSources = true) {
+        TRACE_SCOPE("upload", "TextureArrayPacker::pack");
+        // every loaded texture once, whichever models share it
+        std::vector<Source> sources;
+        std::unordered_map<unsigned int, size_t> sourceIndices;
+        for (const std::shared_ptr<Model>& model : models) {
+            for (size_t i = 0; i < model->textures_loaded.size() && i < model->textureHandles.size(); i++) {
+                const Texture& texture = model->textures_loaded[i];
+                if (texture.id == 0 || texture.array || sourceIndices.count(texture.id))
+                    continue;
+                Source source;
+                source.id = texture.id;
+                source.handle = model->textureHandles[i];
+                if (!getFormat(texture.id, source.format))
+                    continue;
+                sourceIndices[texture.id] = sources.size();
+                sources.push_back(source);
+            }
+        }
+
+        std::map<Format, std::vector<size_t>> groups;
+        for (size_t i = 0; i < sources.size(); i++)
+            groups[sources[i].format].push_back(i);
+
+        GLint maxLayers = 256;
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+        unsigned int packedNow = 0, arraysNow = 0;
+        size_t bytesNow = 0;
+        for (const auto& group : groups) {
+            const std::vector<size_t>& members = group.second;
+            for (size_t first = 0; first < members.size(); first += maxLayers) {
+                size_t count = std::min(members.size() - first, (size_t)maxLayers);
+                if (count < MIN_LAYERS)
+                    continue;
+                std::vector<size_t> layers(members.begin() + first, members.begin() + first + count);
+                bytesNow += createArray(group.first, layers, sources);
+                packedNow += (unsigned int)count;
+                arraysNow++;
+            }
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        ResetBoundTextureArrays();
+
+        // point every copy of a packed texture at its layer
+        for (const std::shared_ptr<Model>& model : models) {
+            for (Texture& texture : model->textures_loaded)
+                assignLayer(texture, sourceIndices, sources);
+            for (Mesh& mesh : model->meshes)
+                for (Texture& texture : mesh.textures)
+                    assignLayer(texture, sourceIndices, sources);
+        }
+        InvalidateMaterialBindings();
+
+        size_t releasedBytes = 0;
+        if (releaseSources)
+            for (const Source& source : sources)
+                if (source.array)
+                    releasedBytes += TextureCache::instance().releaseTexture(source.handle);
+
+        packed += packedNow;
+        std::cout << "Packed " << packedNow << " of " << sources.size() << " textures into " << arraysNow << " texture arrays ("
+                  << bytesNow / (1024 * 1024) << " MB, " << releasedBytes / (1024 * 1024) << " MB of textures released)\n";
+        return packedNow;
+    }
+
+    /**
+     * Gets the number of texture arrays created.
+     */
+    unsigned int getArrayCount() const {
+        return (unsigned int)arrays.size();
+    }
+
+    /**
+     * Gets the number of textures packed into the arrays.
+     */
+    unsigned int getPackedCount() const {
+        return packed;
+    }
+
+private:
+    // what textures must have in common to share an array
+    struct Format {
+        GLint width = 0, height = 0;
+        GLint internalFormat = 0;
+        GLint levels = 0;
+        bool compressed = false;
+
+        bool operator<(const Format& other) const {
+            return std::tie(width, height, internalFormat, levels, compressed) <
+                   std::tie(other.width, other.height, other.internalFormat, other.levels, other.compressed);
+        }
+    };
+
+    struct Source {
+        unsigned int id = 0;
+        TextureHandle handle = INVALID_TEXTURE_HANDLE;
+        Format format;
+        unsigned int array = 0; // set once packed
+        float layer = -1.0f;
+    };
+
+    std::vector<GLTexture> arrays;
+    unsigned int packed = 0;
+
+    // reads the size, format and mipmap count of a 2D texture; returns false if it has no image
+    static bool getFormat(unsigned int id, Format& format) {
+        glBindTexture(GL_TEXTURE_2D, id);
+        GLint compressed = 0, maxLevel = 1000;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &format.width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &format.height);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format.internalFormat);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+        format.compressed = compressed != 0;
+        if (format.width <= 0 || format.height <= 0)
+            return false;
+        // count the mipmaps that were actually uploaded
+        format.levels = 1;
+        while (format.levels <= maxLevel) {
+            GLint width = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, format.levels, GL_TEXTURE_WIDTH, &width);
+            if (width <= 0)
+                break;
+            format.levels++;
+        }
+        return true;
+    }
+
+    // creates an array holding the sources of one format, one per layer, and returns its GPU memory
+    size_t createArray(const Format& format, const std::vector<size_t>& layers, std::vector<Source>& sources) {
+        GLTexture array = GLTexture::create();
+        GLsizei depth = (GLsizei)layers.size();
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array.get());
+        for (GLint level = 0; level < format.levels; level++) {
+            GLsizei width = std::max(1, format.width >> level), height = std::max(1, format.height >> level);
+            if (format.compressed) {
+                GLint layerSize = 0;
+                glBindTexture(GL_TEXTURE_2D, sources[layers[0]].id);
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &layerSize);
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, format.internalFormat, width, height, depth, 0, layerSize * depth, nullptr);
+            }
+            else
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, level, format.internalFormat, width, height, depth, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, format.levels - 1);
+        SetTextureParameters(GL_TEXTURE_2D_ARRAY);
+
+        std::vector<unsigned char> pixels;
+        size_t bytes = 0;
+        for (GLint layer = 0; layer < depth; layer++) {
+            Source& source = sources[layers[layer]];
+            for (GLint level = 0; level < format.levels; level++)
+                copyLevel(source.id, array.get(), format, level, layer, pixels);
+            source.array = array.get();
+            source.layer = (float)layer;
+            bytes += TextureCache::instance().getGpuBytes(source.handle);
+        }
+        array.setMemory(bytes, GPU_TEXTURE);
+        array.setOwner("texture arrays");
+        arrays.push_back(std::move(array));
+        return bytes;
+    }
+
+    // copies one mipmap level of a 2D texture into a layer of an array
+    static void copyLevel(unsigned int source, unsigned int array, const Format& format, GLint level, GLint layer,
+                          std::vector<unsigned char>& pixels) {
+        GLsizei width = std::max(1, format.width >> level), height = std::max(1, format.height >> level);
+        if (GLAD_GL_VERSION_4_3) {
+            glCopyImageSubData(source, GL_TEXTURE_2D, level, 0, 0, 0, array, GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1);
+            return;
+        }
+        // without copy_image the pixels make a round trip through system memory
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, source);
+        if (format.compressed) {
+            GLint size = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+            pixels.resize((size_t)size);
+            glGetCompressedTexImage(GL_TEXTURE_2D, level, pixels.data());
+            glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, format.internalFormat, size, pixels.data());
+        }
+        else {
+            pixels.resize((size_t)width * height * 4);
+            glGetTexImage(GL_TEXTURE_2D, level, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+            glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        }
+    }
+
+    static void assignLayer(Texture& texture, const std::unordered_map<unsigned int, size_t>& sourceIndices,
+                            const std::vector<Source>& sources) {
+        auto found = sourceIndices.find(texture.id);
+        if (found == sourceIndices.end() || !sources[found->second].array)
+            return;
+        texture.array = sources[found->second].array;
+        texture.layer = sources[found->second].layer;
+    }
+};
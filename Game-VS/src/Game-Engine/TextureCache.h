@@ -0,0 +1,416 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include "TextureFile.h"
+#include "TextureStreamer.h"
+#include "TextureCooker.h"
+#include "CompressedTextureCache.h"
+#include "FileCache.h"
+#include "GpuResource.h"
+#include "Trace.h"
+
+/**
+ * Interned handle of an image in the TextureCache. Stays valid for the whole run.
+ */
+typedef unsigned int TextureHandle;
+const TextureHandle INVALID_TEXTURE_HANDLE = ~0u;
+
+/**
+ * Process-wide cache of texture images, shared by every Model. Images are looked up by their normalized absolute path,
+ * and files with identical contents (e.g. the same bark image copied into several model folders) are detected by a hash
+ * of their bytes, so each image is decoded and uploaded to the GPU only once per run.
+ *
+ * Decoding (prepare) may run on worker threads; uploading (getTextureID) must happen on the GL thread.
+ * Once a TextureStreamer is set, request() decodes on the streamer's workers and getTextureID() hands out placeholder
+ * textures that processStreaming() later fills in, so the GL thread never waits for an image.
+ * With compression enabled, images are cooked into block compressed files once and mapped on later runs.
+ */
+class TextureCache {
+public:
+    /**
+     * Gets the single cache used by the whole game.
+     */
+    static TextureCache& instance() {
+        static TextureCache cache;
+        return cache;
+    }
+
+    /**
+     * Gets the lookup key of a texture referenced by a material: its absolute, normalized path.
+     */
+    static std::string normalizePath(const std::string& directory, const std::string& path) {
+        return FileCache::normalizePath(std::filesystem::path(directory) / path);
+    }
+
+    /**
+     * Sets the streamer used to decode and upload images in the background. Must be called on the GL thread,
+     * before any texture is requested. Pass nullptr to go back to decoding and uploading synchronously.
+     */
+    void setStreamer(TextureStreamer* textureStreamer) {
+        std::lock_guard<std::mutex> lock(mutex);
+        streamer = textureStreamer;
+    }
+
+    /**
+     * Enables block compressed textures. Images are cooked with the TextureCooker the first time they are loaded,
+     * and read from their cooked file on later runs. Only enable if TextureCooker::isSupported().
+     */
+    void setCompression(bool enabled) {
+        std::lock_guard<std::mutex> lock(mutex);
+        compression = enabled;
+    }
+
+    /**
+     * Checks if textures are streamed in the background.
+     */
+    bool isStreaming() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return streamer != nullptr;
+    }
+
+    /**
+     * Makes sure the image of a material texture is decoded (or already on the GPU) and returns its handle.
+     * If another thread is decoding the same image, waits for it instead of decoding it twice. Safe to call from any thread.
+     */
+    TextureHandle prepare(const std::string& directory, const std::string& path) {
+        std::unique_lock<std::mutex> lock(mutex);
+        bool claimed;
+        TextureHandle handle = claim(normalizePath(directory, path), claimed);
+        if (claimed) {
+            lock.unlock();
+            decodeClaimed(handle, path);
+            lock.lock();
+        }
+        waitUntilDecoded(lock, handle);
+        return handle;
+    }
+
+    /**
+     * Gets the handle of a material texture without waiting for it. With a streamer set, new images are decoded
+     * on its worker threads; without one, this is the same as prepare(). Safe to call from any thread.
+     */
+    TextureHandle request(const std::string& directory, const std::string& path) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!streamer) {
+            lock.unlock();
+            return prepare(directory, path);
+        }
+        bool claimed;
+        TextureHandle handle = claim(normalizePath(directory, path), claimed);
+        if (claimed)
+            streamer->getWorkerPool().submit([this, handle, path]() { decodeClaimed(handle, path); });
+        return handle;
+    }
+
+    /**
+     * Gets the OpenGL texture of an image, uploading it on first use. Must be called on the GL thread.
+     * With a streamer set, an image that isn't on the GPU yet gets a placeholder texture, which is filled in
+     * by processStreaming() under the same name.
+     * @param gpuBytes set to the GPU memory used by the texture so far, including mipmaps
+     */
+    unsigned int getTextureID(TextureHandle handle, size_t* gpuBytes = nullptr) {
+        std::lock_guard<std::mutex> lock(mutex);
+        TextureHandle resolved = entries[handle].state == ENTRY_DECODED ? resolve(handle) : handle;
+        Entry& entry = entries[resolved];
+        if (entry.released) {
+            if (gpuBytes)
+                *gpuBytes = 0;
+            return 0;
+        }
+        if (!entry.texture) {
+            if (streamer) {
+                entry.texture = GLTexture(streamer->createPlaceholder());
+                streaming.push_back(resolved);
+            }
+            else {
+                if (entry.compressed.isOpen())
+                    entry.texture = GLTexture(TextureFromCompressed(entry.compressed, &entry.gpuBytes));
+                else
+                    entry.texture = GLTexture(TextureFromImage(entry.image, &entry.gpuBytes));
+                // the pixels are on the GPU now
+                entry.compressed.close();
+                entry.image.pixels.reset();
+                uploads++;
+            }
+            entry.texture.setMemory(entry.gpuBytes, GPU_TEXTURE);
+            entry.texture.setOwner(entry.key);
+        }
+        else {
+            sharedUses++;
+            entry.sharedUses++;
+        }
+        if (gpuBytes)
+            *gpuBytes = entry.gpuBytes;
+        return entry.texture.get();
+    }
+
+    /**
+     * Decodes (if needed) and uploads (if needed) a material texture in one go. Must be called on the GL thread.
+     */
+    unsigned int load(const std::string& directory, const std::string& path, size_t* gpuBytes = nullptr) {
+        return getTextureID(request(directory, path), gpuBytes);
+    }
+
+    /**
+     * Uploads the decoded images of placeholder textures through the streamer. Must be called on the GL thread,
+     * usually once per frame. Stops once the time budget is used up or every streaming buffer is busy.
+     * @return the number of textures that got their real image during this call
+     */
+    unsigned int processStreaming(double budgetMS) {
+        auto start = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(mutex);
+        unsigned int completed = 0;
+        for (size_t i = 0; i < streaming.size();) {
+            if (std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() >= budgetMS)
+                break;
+            TextureHandle handle = streaming[i];
+            if (entries[handle].state != ENTRY_DECODED) {
+                i++;
+                continue;
+            }
+            // entries only get a placeholder while they are still decoding or once they are known not to be an alias,
+            // so the image is always their own
+            Entry& entry = entries[handle];
+            if (entry.compressed.isOpen() || entry.image.isValid()) {
+                bool uploaded = entry.compressed.isOpen() ? streamer->upload(entry.texture.get(), entry.compressed, &entry.gpuBytes)
+                                                          : streamer->upload(entry.texture.get(), entry.image, &entry.gpuBytes);
+                // every buffer is busy, or one couldn't be mapped: the texture keeps its placeholder until next frame
+                if (!uploaded)
+                    break;
+                entry.texture.setMemory(entry.gpuBytes, GPU_TEXTURE);
+                uploads++;
+            }
+            // an image that failed to decode keeps its placeholder
+            entry.compressed.close();
+            entry.image.pixels.reset();
+            streaming.erase(streaming.begin() + i);
+            completed++;
+        }
+        return completed;
+    }
+
+    /**
+     * Deletes the texture of an image whose pixels were copied elsewhere, e.g. into a texture array by the
+     * TextureArrayPacker, once nothing binds it anymore. Its paths are forgotten, so a later request for any of them
+     * reads the file again into a new entry; the old handles get texture 0. Must be called on the GL thread.
+     * Returns the GPU memory freed.
+     */
+    size_t releaseTexture(TextureHandle handle) {
+        std::lock_guard<std::mutex> lock(mutex);
+        TextureHandle resolved = resolve(handle);
+        Entry& entry = entries[resolved];
+        // a placeholder still waiting for its image is left alone
+        if (entry.state != ENTRY_DECODED || !entry.texture ||
+            std::find(streaming.begin(), streaming.end(), resolved) != streaming.end())
+            return 0;
+        size_t freed = entry.gpuBytes;
+        entry.texture.reset();
+        entry.gpuBytes = 0;
+        entry.released = true;
+        for (auto path = byPath.begin(); path != byPath.end();) {
+            if (resolve(path->second) == resolved) {
+                entries[path->second].released = true;
+                path = byPath.erase(path);
+            }
+            else
+                ++path;
+        }
+        for (auto content = byContent.begin(); content != byContent.end();) {
+            if (content->second == resolved)
+                content = byContent.erase(content);
+            else
+                ++content;
+        }
+        releasedTextures++;
+        return freed;
+    }
+
+    /**
+     * Gets the number of placeholder textures still waiting for their image.
+     */
+    size_t getStreamingCount() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return streaming.size();
+    }
+
+    /**
+     * Gets the GPU memory used by the texture of an image, 0 if it isn't on the GPU yet.
+     */
+    size_t getGpuBytes(TextureHandle handle) {
+        std::lock_guard<std::mutex> lock(mutex);
+        TextureHandle resolved = entries[handle].state == ENTRY_DECODED ? resolve(handle) : handle;
+        return entries[resolved].gpuBytes;
+    }
+
+    /**
+     * Prints how many texture requests were served by images that were already decoded or uploaded.
+     */
+    void printStats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        // streamed textures only know their size once uploaded, so the savings are added up here
+        size_t savedBytes = 0;
+        for (const Entry& entry : entries)
+            savedBytes += entry.sharedUses * entry.gpuBytes;
+        std::cout << "Texture Cache: " << lookups << " lookups, " << pathHits << " path hits, " << contentHits
+                  << " identical files, " << uploads << " textures uploaded\n";
+        std::cout << "Texture Cache: " << cookedLoads << " loaded from cooked files, " << cookedWrites << " cooked\n";
+        std::cout << "Texture Cache: " << sharedUses << " shared uses, " << savedBytes / (1024 * 1024) << " MB saved by sharing\n";
+        if (releasedTextures)
+            std::cout << "Texture Cache: " << releasedTextures << " textures released after being packed\n";
+    }
+
+private:
+    enum EntryState {
+        ENTRY_DECODING,
+        ENTRY_DECODED
+    };
+
+    struct Entry {
+        std::string key;
+        EntryState state = ENTRY_DECODING;
+        TextureHandle target = INVALID_TEXTURE_HANDLE; // entry holding the image, if this path is a copy of another file
+        DecodedImage image;                            // released once uploaded
+        CompressedTextureCache compressed;             // mapped cooked file, used instead of image when open; closed once uploaded
+        GLTexture texture;                             // created on first use, deleted along with the cache
+        size_t gpuBytes = 0;
+        unsigned int sharedUses = 0;                   // number of times the texture was handed out after the first
+        bool released = false;                         // texture deleted by releaseTexture; the path is no longer looked up
+    };
+
+    std::mutex mutex;
+    std::condition_variable decoded;
+    std::deque<Entry> entries;   // indexed by handle; a deque so entries never move
+    std::unordered_map<std::string, TextureHandle> byPath;
+    std::unordered_map<uint64_t, TextureHandle> byContent;
+    TextureStreamer* streamer = nullptr;
+    bool compression = false;
+    std::vector<TextureHandle> streaming; // entries with a placeholder texture, waiting for their image
+
+    unsigned int lookups = 0;
+    unsigned int pathHits = 0;
+    unsigned int contentHits = 0;
+    unsigned int uploads = 0;
+    unsigned int cookedLoads = 0;
+    unsigned int cookedWrites = 0;
+    unsigned int sharedUses = 0;
+    unsigned int releasedTextures = 0;
+
+    TextureCache() {}
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    /**
+     * Finds the entry of a normalized path, or creates one for the calling thread to decode. Called with the lock held.
+     */
+    TextureHandle claim(const std::string& key, bool& claimed) {
+        lookups++;
+        auto found = byPath.find(key);
+        if (found != byPath.end()) {
+            pathHits++;
+            claimed = false;
+            return found->second;
+        }
+        // claim the path so that other threads asking for it wait for this one
+        TextureHandle handle = (TextureHandle)entries.size();
+        entries.emplace_back();
+        entries.back().key = key;
+        byPath[key] = handle;
+        claimed = true;
+        return handle;
+    }
+
+    /**
+     * Reads, hashes and decodes the file of a claimed entry. Runs without the lock held.
+     */
+    void decodeClaimed(TextureHandle handle, const std::string& path) {
+        std::unique_lock<std::mutex> lock(mutex);
+        // only the claiming thread touches the entry's image data until it is marked as decoded
+        Entry& entry = entries[handle];
+        std::string key = entry.key;
+        bool compress = compression;
+        lock.unlock();
+
+        // warm start: a cooked file that is still up to date replaces reading and decoding the image
+        std::vector<char> bytes;
+        bool cooked = compress && entry.compressed.open(key);
+        bool readable = cooked || readFile(key, bytes);
+        uint64_t contentHash = cooked ? entry.compressed.getContentHash() : FileCache::hash(bytes.data(), bytes.size());
+
+        lock.lock();
+        if (readable) {
+            auto sameContent = byContent.find(contentHash);
+            // a path that already got its own placeholder texture keeps it, rather than being aliased after the fact
+            if (sameContent != byContent.end() && !entry.texture) {
+                // identical file under another path: alias it rather than decoding it again
+                contentHits++;
+                entry.compressed.close();
+                entry.target = sameContent->second;
+                entry.state = ENTRY_DECODED;
+                decoded.notify_all();
+                return;
+            }
+            if (sameContent == byContent.end())
+                byContent[contentHash] = handle;
+        }
+        if (cooked) {
+            cookedLoads++;
+            entry.state = ENTRY_DECODED;
+            decoded.notify_all();
+            return;
+        }
+        lock.unlock();
+
+        DecodedImage image;
+        if (readable) {
+            std::cout << "Loading Texture from file " << path << "\n";
+            image = DecodeImageFromMemory(path, reinterpret_cast<const unsigned char*>(bytes.data()), bytes.size());
+        }
+        else
+            std::cout << "Texture failed to load at path: " << path << std::endl;
+        // cold start: cook the image so the next run can map the compressed blocks instead
+        bool cookedNow = compress && image.isValid() && CompressedTextureCache::write(key, contentHash, TextureCooker::cook(image))
+            && entry.compressed.open(key);
+        if (cookedNow)
+            image.pixels.reset();
+
+        lock.lock();
+        if (cookedNow)
+            cookedWrites++;
+        entry.image = std::move(image);
+        entry.state = ENTRY_DECODED;
+        decoded.notify_all();
+    }
+
+    TextureHandle resolve(TextureHandle handle) const {
+        return entries[handle].target == INVALID_TEXTURE_HANDLE ? handle : entries[handle].target;
+    }
+
+    void waitUntilDecoded(std::unique_lock<std::mutex>& lock, TextureHandle handle) {
+        decoded.wait(lock, [this, handle]() {
+            return entries[handle].state == ENTRY_DECODED && entries[resolve(handle)].state == ENTRY_DECODED;
+        });
+    }
+
+    static bool readFile(const std::string& path, std::vector<char>& bytes) {
+        TRACE_SCOPE("io", "readFile", path);
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file)
+            return false;
+        std::streamsize size = file.tellg();
+        if (size <= 0)
+            return false;
+        bytes.resize((size_t)size);
+        file.seekg(0);
+        return (bool)file.read(bytes.data(), size);
+    }
+};
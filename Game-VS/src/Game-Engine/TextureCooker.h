@@ -0,0 +1,293 @@
+#pragma once
+#include <glad.h>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include "TextureFile.h"
+#include "Trace.h"
+
+// S3TC formats come from EXT_texture_compression_s3tc, which isn't part of the core profile glad was generated for
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+/**
+ * One mip level of a block compressed texture.
+ */
+struct CookedLevel {
+    int width = 0, height = 0;
+    std::vector<unsigned char> blocks;
+};
+
+/**
+ * A block compressed texture with its full mip chain, ready for glCompressedTexImage2D.
+ */
+struct CookedTexture {
+    GLenum internalFormat = 0;
+    std::vector<CookedLevel> levels;
+
+    size_t getByteSize() const {
+        size_t bytes = 0;
+        for (const CookedLevel& level : levels)
+            bytes += level.blocks.size();
+        return bytes;
+    }
+};
+
+/**
+ * CPU encoder turning decoded images into block compressed textures: BC1 (DXT1) for opaque colour images, BC3 (DXT5)
+ * for images with alpha, BC4 (RGTC1) for single channel and BC5 (RGTC2) for two channel images. Every 4x4 block
+ * becomes 8 bytes (BC1, BC4) or 16 bytes (BC3, BC5), a 4-8x reduction over the uncompressed pixels.
+ * Doesn't make any OpenGL calls except isSupported(), so cooking can run on worker threads.
+ */
+class TextureCooker {
+public:
+    /**
+     * Checks if the current context can sample S3TC textures. RGTC is core since OpenGL 3.0. Must be called on the GL thread.
+     */
+    static bool isSupported() {
+        GLint numExtensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+        for (GLint i = 0; i < numExtensions; i++) {
+            const char* name = (const char*)glGetStringi(GL_EXTENSIONS, (GLuint)i);
+            if (name && std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0)
+                return true;
+        }
+        return false;
+    }
+
+    /**
+     * Builds the mip chain of an image with a box filter and block compresses every level.
+     */
+    static CookedTexture cook(const DecodedImage& image) {
+        TRACE_SCOPE("cook", "TextureCooker::cook");
+        CookedTexture cooked;
+        int components = image.components;
+        bool alpha = components == 4 && hasTranslucentPixels(image);
+        if (components == 1)
+            cooked.internalFormat = GL_COMPRESSED_RED_RGTC1;
+        else if (components == 2)
+            cooked.internalFormat = GL_COMPRESSED_RG_RGTC2;
+        else if (alpha)
+            cooked.internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        else
+            cooked.internalFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+
+        int width = image.width, height = image.height;
+        std::vector<unsigned char> pixels(image.pixels.get(), image.pixels.get() + image.getByteSize());
+        while (true) {
+            CookedLevel level;
+            level.width = width;
+            level.height = height;
+            compressLevel(pixels.data(), width, height, components, cooked.internalFormat, level.blocks);
+            cooked.levels.push_back(std::move(level));
+            if (width == 1 && height == 1)
+                break;
+            pixels = downsample(pixels, width, height, components);
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+        return cooked;
+    }
+
+    /**
+     * Gets the size in bytes of one 4x4 block of a compressed format.
+     */
+    static unsigned int blockSize(GLenum internalFormat) {
+        return internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || internalFormat == GL_COMPRESSED_RED_RGTC1 ? 8 : 16;
+    }
+
+private:
+    static bool hasTranslucentPixels(const DecodedImage& image) {
+        const unsigned char* pixels = image.pixels.get();
+        size_t numPixels = (size_t)image.width * image.height;
+        for (size_t i = 0; i < numPixels; i++)
+            if (pixels[i * 4 + 3] != 255)
+                return true;
+        return false;
+    }
+
+    /**
+     * Halves an image in both dimensions, averaging 2x2 pixels (edge pixels are repeated for odd sizes).
+     */
+    static std::vector<unsigned char> downsample(const std::vector<unsigned char>& pixels, int width, int height, int components) {
+        int newWidth = std::max(1, width / 2), newHeight = std::max(1, height / 2);
+        std::vector<unsigned char> result((size_t)newWidth * newHeight * components);
+        for (int y = 0; y < newHeight; y++) {
+            int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+            for (int x = 0; x < newWidth; x++) {
+                int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+                for (int c = 0; c < components; c++) {
+                    int sum = pixels[((size_t)y0 * width + x0) * components + c] + pixels[((size_t)y0 * width + x1) * components + c]
+                            + pixels[((size_t)y1 * width + x0) * components + c] + pixels[((size_t)y1 * width + x1) * components + c];
+                    result[((size_t)y * newWidth + x) * components + c] = (unsigned char)((sum + 2) / 4);
+                }
+            }
+        }
+        return result;
+    }
+
+    static void compressLevel(const unsigned char* pixels, int width, int height, int components, GLenum format,
+                              std::vector<unsigned char>& blocks) {
+        int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+        unsigned int size = blockSize(format);
+        blocks.resize((size_t)blocksX * blocksY * size);
+        unsigned char* out = blocks.data();
+        for (int by = 0; by < blocksY; by++) {
+            for (int bx = 0; bx < blocksX; bx++) {
+                // gather the block as RGBA, repeating edge pixels for blocks that stick out of the image
+                unsigned char block[16][4];
+                for (int i = 0; i < 16; i++) {
+                    int x = std::min(bx * 4 + i % 4, width - 1), y = std::min(by * 4 + i / 4, height - 1);
+                    const unsigned char* pixel = pixels + ((size_t)y * width + x) * components;
+                    block[i][0] = pixel[0];
+                    block[i][1] = components > 1 ? pixel[1] : 0;
+                    block[i][2] = components > 2 ? pixel[2] : 0;
+                    block[i][3] = components > 3 ? pixel[3] : 255;
+                }
+                if (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+                    compressColorBlock(block, out);
+                else if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+                    compressChannelBlock(block, 3, out);
+                    compressColorBlock(block, out + 8);
+                }
+                else if (format == GL_COMPRESSED_RED_RGTC1)
+                    compressChannelBlock(block, 0, out);
+                else {
+                    compressChannelBlock(block, 0, out);
+                    compressChannelBlock(block, 1, out + 8);
+                }
+                out += size;
+            }
+        }
+    }
+
+    static uint16_t packColor565(const float color[3]) {
+        int r = std::min(31, std::max(0, (int)(color[0] * 31.0f / 255.0f + 0.5f)));
+        int g = std::min(63, std::max(0, (int)(color[1] * 63.0f / 255.0f + 0.5f)));
+        int b = std::min(31, std::max(0, (int)(color[2] * 31.0f / 255.0f + 0.5f)));
+        return (uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    static void unpackColor565(uint16_t packed, int color[3]) {
+        int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    /**
+     * Encodes the RGB part of a block as BC1: two RGB565 endpoints on the block's principal colour axis
+     * and a 2-bit index per pixel into the 4-colour palette they span.
+     */
+    static void compressColorBlock(const unsigned char block[16][4], unsigned char* out) {
+        float mean[3] = { 0, 0, 0 };
+        for (int i = 0; i < 16; i++)
+            for (int c = 0; c < 3; c++)
+                mean[c] += block[i][c] / 16.0f;
+        float covariance[6] = { 0, 0, 0, 0, 0, 0 };
+        for (int i = 0; i < 16; i++) {
+            float d[3] = { block[i][0] - mean[0], block[i][1] - mean[1], block[i][2] - mean[2] };
+            covariance[0] += d[0] * d[0]; covariance[1] += d[0] * d[1]; covariance[2] += d[0] * d[2];
+            covariance[3] += d[1] * d[1]; covariance[4] += d[1] * d[2]; covariance[5] += d[2] * d[2];
+        }
+        // a few power iterations are enough to find the dominant axis
+        float axis[3] = { 1, 1, 1 };
+        for (int iteration = 0; iteration < 4; iteration++) {
+            float next[3] = {
+                covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+                covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+                covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2]
+            };
+            float length = std::max(std::max(std::abs(next[0]), std::abs(next[1])), std::abs(next[2]));
+            if (length < 1e-6f)
+                break;
+            for (int c = 0; c < 3; c++)
+                axis[c] = next[c] / length;
+        }
+        float minProjection = 1e30f, maxProjection = -1e30f;
+        for (int i = 0; i < 16; i++) {
+            float projection = (block[i][0] - mean[0]) * axis[0] + (block[i][1] - mean[1]) * axis[1] + (block[i][2] - mean[2]) * axis[2];
+            minProjection = std::min(minProjection, projection);
+            maxProjection = std::max(maxProjection, projection);
+        }
+        float axisLengthSquared = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+        float maxColor[3], minColor[3];
+        for (int c = 0; c < 3; c++) {
+            maxColor[c] = mean[c] + axis[c] * maxProjection / axisLengthSquared;
+            minColor[c] = mean[c] + axis[c] * minProjection / axisLengthSquared;
+        }
+
+        uint16_t color0 = packColor565(maxColor), color1 = packColor565(minColor);
+        // color0 > color1 selects the 4-colour mode; equal endpoints get all-zero indices
+        if (color0 < color1)
+            std::swap(color0, color1);
+        uint32_t indices = 0;
+        if (color0 != color1) {
+            int palette[4][3];
+            unpackColor565(color0, palette[0]);
+            unpackColor565(color1, palette[1]);
+            for (int c = 0; c < 3; c++) {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            for (int i = 0; i < 16; i++) {
+                int best = 0, bestDistance = 1 << 30;
+                for (int p = 0; p < 4; p++) {
+                    int dr = block[i][0] - palette[p][0], dg = block[i][1] - palette[p][1], db = block[i][2] - palette[p][2];
+                    int distance = dr * dr + dg * dg + db * db;
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        best = p;
+                    }
+                }
+                indices |= (uint32_t)best << (i * 2);
+            }
+        }
+        out[0] = (unsigned char)(color0 & 0xFF);
+        out[1] = (unsigned char)(color0 >> 8);
+        out[2] = (unsigned char)(color1 & 0xFF);
+        out[3] = (unsigned char)(color1 >> 8);
+        for (int b = 0; b < 4; b++)
+            out[4 + b] = (unsigned char)(indices >> (b * 8));
+    }
+
+    /**
+     * Encodes one channel of a block as a BC4 block (also used for BC3 alpha and both halves of BC5):
+     * two 8-bit endpoints and a 3-bit index per pixel into the 8 values they span.
+     */
+    static void compressChannelBlock(const unsigned char block[16][4], int channel, unsigned char* out) {
+        int minValue = 255, maxValue = 0;
+        for (int i = 0; i < 16; i++) {
+            minValue = std::min(minValue, (int)block[i][channel]);
+            maxValue = std::max(maxValue, (int)block[i][channel]);
+        }
+        uint64_t indices = 0;
+        if (maxValue != minValue) {
+            // value0 > value1 selects the 8-value mode: index 0 and 1 are the endpoints, 2-7 interpolate between them
+            int values[8] = { maxValue, minValue };
+            for (int v = 1; v < 7; v++)
+                values[v + 1] = ((7 - v) * maxValue + v * minValue) / 7;
+            for (int i = 0; i < 16; i++) {
+                int best = 0, bestDistance = 256;
+                for (int v = 0; v < 8; v++) {
+                    int distance = std::abs(block[i][channel] - values[v]);
+                    if (distance < bestDistance) {
+                        bestDistance = distance;
+                        best = v;
+                    }
+                }
+                indices |= (uint64_t)best << (i * 3);
+            }
+        }
+        out[0] = (unsigned char)maxValue;
+        out[1] = (unsigned char)minValue;
+        for (int b = 0; b < 6; b++)
+            out[2 + b] = (unsigned char)(indices >> (b * 8));
+    }
+};
@@ -0,0 +1,90 @@
+#pragma once
+#include <glad.h>
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#include <string>
+#include <memory>
+#include <iostream>
+#include "Trace.h"
+
+/**
+ * Pixels of an image file decoded by STBI image. Decoding doesn't touch OpenGL, so it can be done on any thread;
+ * the result is later uploaded on the thread that owns the GL context with TextureFromImage().
+ */
+struct DecodedImage {
+    struct PixelDeleter {
+        void operator()(unsigned char* pixels) const { stbi_image_free(pixels); }
+    };
+
+    std::string path;   // path relative to the model directory, as referenced by the material
+    int width = 0, height = 0, components = 0;
+    std::unique_ptr<unsigned char, PixelDeleter> pixels;
+
+    bool isValid() const {
+        return pixels != nullptr;
+    }
+
+    size_t getByteSize() const {
+        return (size_t)width * height * components;
+    }
+};
+
+/**
+ * Decodes a texture file that has already been read into memory. Safe to call from worker threads.
+ * @param path the path the file was read from, used for the result and error messages
+ */
+inline DecodedImage DecodeImageFromMemory(const std::string& path, const unsigned char* data, size_t size) {
+    TRACE_SCOPE("decode", "DecodeImage", path);
+    DecodedImage image;
+    image.path = path;
+    image.pixels.reset(stbi_load_from_memory(data, (int)size, &image.width, &image.height, &image.components, 0));
+    if (!image.isValid())
+        std::cout << "Texture failed to load at path: " << path << std::endl;
+    return image;
+}
+
+/**
+ * Gets the OpenGL pixel format of an image with the provided number of components.
+ */
+inline GLenum ImageFormat(int components) {
+    if (components == 1)
+        return GL_RED;
+    else if (components == 2)
+        return GL_RG;
+    else if (components == 3)
+        return GL_RGB;
+    return GL_RGBA;
+}
+
+/**
+ * Sets the wrapping and filtering used by model textures on the currently bound, mipmapped texture.
+ * @param target GL_TEXTURE_2D, or GL_TEXTURE_2D_ARRAY for textures packed by the TextureArrayPacker
+ */
+inline void SetTextureParameters(GLenum target = GL_TEXTURE_2D) {
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+/**
+ * Creates an OpenGL texture (with mipmaps) from decoded pixels. Must be called on the GL thread.
+ * An invalid image still produces a texture name, so a missing file leaves the material with an empty texture.
+ */
+inline unsigned int TextureFromImage(const DecodedImage& image, size_t* uploadedBytes = nullptr) {
+    TRACE_SCOPE("upload", "TextureFromImage");
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    if (image.isValid()) {
+        GLenum format = ImageFormat(image.components);
+
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels.get());
+        glGenerateMipmap(GL_TEXTURE_2D);
+        // a full mipmap chain adds about a third on top of the base level
+        if (uploadedBytes)
+            *uploadedBytes = image.getByteSize() * 4 / 3;
+        SetTextureParameters();
+    }
+    return textureID;
+}
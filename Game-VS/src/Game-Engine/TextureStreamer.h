@@ -0,0 +1,245 @@
+#pragma once
+#include <glad.h>
+#include <cstring>
+#include <vector>
+#include "TextureFile.h"
+#include "CompressedTextureCache.h"
+#include "WorkerPool.h"
+#include "GpuResource.h"
+#include "Trace.h"
+
+/**
+ * Uploads decoded images to existing textures through a ring of pixel buffer objects, so the GL thread only copies
+ * the pixels into a buffer and the driver transfers them to the texture asynchronously. Textures start out as a 1x1
+ * placeholder and get their real image later, under the same texture name, so meshes never need to be updated.
+ *
+ * The buffers are persistently mapped when the context supports GL 4.4 (glBufferStorage), and mapped for every upload
+ * otherwise. Each slot of the ring is guarded by a fence and is only reused once the GPU is done reading from it.
+ * All methods must be called on the GL thread. Decoding is done on the provided worker pool.
+ */
+class TextureStreamer {
+public:
+    static const unsigned int NUM_SLOTS = 4;
+    // initial size of each ring slot, enough for a 1024x1024 RGBA image; slots grow for bigger images
+    static const size_t INITIAL_SLOT_SIZE = 1024 * 1024 * 4;
+
+    explicit TextureStreamer(WorkerPool& workers) : workers(workers), persistent(GLAD_GL_VERSION_4_4 != 0) {
+        slots.resize(NUM_SLOTS);
+        // a slot that fails to allocate is left empty, and allocated again when it is next used
+        for (Slot& slot : slots)
+            allocateSlot(slot, INITIAL_SLOT_SIZE);
+    }
+
+    ~TextureStreamer() {
+        for (Slot& slot : slots)
+            releaseSlot(slot);
+    }
+
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    /**
+     * Gets the worker pool images are decoded on.
+     */
+    WorkerPool& getWorkerPool() {
+        return workers;
+    }
+
+    /**
+     * Creates a texture holding a single mid-grey pixel, to be drawn with until the real image has been uploaded.
+     */
+    unsigned int createPlaceholder() {
+        static const unsigned char PIXEL[4] = { 128, 128, 128, 255 };
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, PIXEL);
+        // no mipmaps yet, so the minification filter must not use them or the texture would be incomplete
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return textureID;
+    }
+
+    /**
+     * Replaces the contents of a texture with a decoded image, going through the next free buffer of the ring.
+     * Returns false without doing anything if every buffer is still in use by the GPU, or if the buffer couldn't be
+     * mapped; the texture keeps its placeholder, try again next frame.
+     * @param uploadedBytes set to the GPU memory used by the texture, including mipmaps
+     */
+    bool upload(unsigned int textureID, const DecodedImage& image, size_t* uploadedBytes = nullptr) {
+        TRACE_SCOPE("upload", "TextureStreamer::upload");
+        size_t size = image.getByteSize();
+        Slot* slot = acquireSlot(size);
+        if (!slot)
+            return false;
+        unsigned char* mapped = mapSlot(*slot, size);
+        if (!mapped) {
+            abandonSlot(*slot);
+            return false;
+        }
+        std::memcpy(mapped, image.pixels.get(), size);
+        unmapSlot();
+
+        GLenum format = ImageFormat(image.components);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        // with a pixel unpack buffer bound, the data pointer is an offset into the buffer
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, (void*)0);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        SetTextureParameters();
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        if (uploadedBytes)
+            *uploadedBytes = size * 4 / 3;
+        return true;
+    }
+
+    /**
+     * Replaces the contents of a texture with a cooked, block compressed image and its mip levels.
+     * Returns false without doing anything if every buffer is still in use by the GPU, or if the buffer couldn't be
+     * mapped; the texture keeps its placeholder, try again next frame.
+     */
+    bool upload(unsigned int textureID, const CompressedTextureCache& compressed, size_t* uploadedBytes = nullptr) {
+        TRACE_SCOPE("upload", "TextureStreamer::upload compressed");
+        const std::vector<CompressedLevel>& levels = compressed.getLevels();
+        std::vector<size_t> offsets;
+        size_t size = 0;
+        for (const CompressedLevel& level : levels) {
+            offsets.push_back(size);
+            size += level.size;
+        }
+        Slot* slot = acquireSlot(size);
+        if (!slot)
+            return false;
+        unsigned char* mapped = mapSlot(*slot, size);
+        if (!mapped) {
+            abandonSlot(*slot);
+            return false;
+        }
+        for (size_t i = 0; i < levels.size(); i++)
+            std::memcpy(mapped + offsets[i], levels[i].data, levels[i].size);
+        unmapSlot();
+
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        for (size_t i = 0; i < levels.size(); i++)
+            glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, compressed.getInternalFormat(), levels[i].width, levels[i].height, 0,
+                                   (GLsizei)levels[i].size, (void*)offsets[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+        SetTextureParameters();
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        if (uploadedBytes)
+            *uploadedBytes = size;
+        return true;
+    }
+
+private:
+    struct Slot {
+        GLBuffer buffer;
+        size_t capacity = 0;
+        void* mapped = nullptr; // only used when persistently mapped
+        GLsync fence = 0;       // signaled once the GPU is done reading the last upload from this slot
+    };
+
+    WorkerPool& workers;
+    bool persistent;
+    std::vector<Slot> slots;
+    unsigned int nextSlot = 0;
+
+    /**
+     * Finds the next slot the GPU is done with, grown to hold at least the provided number of bytes, or nullptr if all are busy
+     * or the slot couldn't be grown.
+     */
+    Slot* acquireSlot(size_t size) {
+        for (unsigned int i = 0; i < slots.size(); i++) {
+            Slot& slot = slots[(nextSlot + i) % slots.size()];
+            if (isSlotFree(slot)) {
+                nextSlot = (nextSlot + i + 1) % slots.size();
+                if (size > slot.capacity) {
+                    releaseSlot(slot);
+                    if (!allocateSlot(slot, size))
+                        return nullptr;
+                }
+                return &slot;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * Binds a slot as the pixel unpack buffer and gets a pointer to write the upload into, or nullptr if the driver
+     * failed to map it.
+     */
+    unsigned char* mapSlot(Slot& slot, size_t size) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer.get());
+        if (persistent)
+            return static_cast<unsigned char*>(slot.mapped);
+        return static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    }
+
+    /**
+     * Frees a slot that couldn't be mapped and unbinds it; it is allocated again when it is next used.
+     */
+    void abandonSlot(Slot& slot) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        releaseSlot(slot);
+    }
+
+    void unmapSlot() {
+        if (!persistent)
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+
+    bool isSlotFree(Slot& slot) {
+        if (!slot.fence)
+            return true;
+        GLenum status = glClientWaitSync(slot.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            return false;
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+        return true;
+    }
+
+    /**
+     * Creates the buffer of a slot. Returns false, leaving the slot empty, if the persistent mapping failed.
+     */
+    bool allocateSlot(Slot& slot, size_t size) {
+        slot.buffer = GLBuffer::create();
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer.get());
+        if (persistent) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+            slot.mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+            if (!slot.mapped) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                slot.buffer.reset();
+                slot.capacity = 0;
+                return false;
+            }
+        }
+        else
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        slot.capacity = size;
+        slot.buffer.setMemory(size, GPU_STAGING_BUFFER);
+        slot.buffer.setOwner("texture streamer");
+        return true;
+    }
+
+    void releaseSlot(Slot& slot) {
+        if (slot.fence) {
+            glDeleteSync(slot.fence);
+            slot.fence = 0;
+        }
+        if (slot.mapped) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer.get());
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            slot.mapped = nullptr;
+        }
+        slot.buffer.reset();
+        slot.capacity = 0;
+    }
+};
@@ -0,0 +1,212 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Process-wide recorder of timed trace events, written as Chrome trace-event JSON that chrome://tracing and
+ * ui.perfetto.dev open directly. Each event has a category (e.g. "io", "import", "decode", "upload"), a name,
+ * an optional detail such as the asset path, and the thread it ran on, so the overlap of parallel loading is visible.
+ *
+ * Events are recorded with TRACE_SCOPE while tracing is enabled; when disabled, a scope costs one atomic load.
+ * Thread-safe.
+ */
+class Tracer {
+public:
+    /**
+     * Gets the single tracer used by the whole game.
+     */
+    static Tracer& instance() {
+        // never destroyed, so scopes on threads that outlive main's objects can still check it
+        static Tracer* tracer = new Tracer();
+        return *tracer;
+    }
+
+    /**
+     * Starts or stops recording events. Events already recorded are kept until written or cleared.
+     */
+    void setEnabled(bool enable) {
+        enabled.store(enable, std::memory_order_relaxed);
+    }
+
+    bool isEnabled() const {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Names the calling thread in the trace, e.g. "main" or "asset worker".
+     */
+    void setThreadName(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        threadNames.emplace_back(getThreadId(), name);
+    }
+
+    /**
+     * Gets the time since the tracer was created, in microseconds, which is the time base of the events.
+     */
+    int64_t now() const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    /**
+     * Records a finished event of the calling thread.
+     * @param start start time, from now()
+     */
+    void record(const char* category, std::string name, std::string detail, int64_t start, int64_t duration) {
+        Event event;
+        event.category = category;
+        event.name = std::move(name);
+        event.detail = std::move(detail);
+        event.start = start;
+        event.duration = duration;
+        event.thread = getThreadId();
+        std::lock_guard<std::mutex> lock(mutex);
+        events.push_back(std::move(event));
+    }
+
+    /**
+     * Gets the number of events recorded so far.
+     */
+    size_t getEventCount() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return events.size();
+    }
+
+    /**
+     * Writes the recorded events to a JSON file in the Chrome trace-event format. Returns false if it can't be written.
+     */
+    bool write(const std::string& path) {
+        std::ofstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+        std::lock_guard<std::mutex> lock(mutex);
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        bool first = true;
+        for (const auto& thread : threadNames) {
+            file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread.first
+                 << ",\"args\":{\"name\":\"" << escape(thread.second) << "\"}}";
+            first = false;
+        }
+        for (const Event& event : events) {
+            file << (first ? "" : ",\n") << "{\"name\":\"" << escape(event.name) << "\",\"cat\":\"" << event.category
+                 << "\",\"ph\":\"X\",\"ts\":" << event.start << ",\"dur\":" << event.duration << ",\"pid\":1,\"tid\":" << event.thread;
+            if (!event.detail.empty())
+                file << ",\"args\":{\"detail\":\"" << escape(event.detail) << "\"}";
+            file << "}";
+            first = false;
+        }
+        file << "\n]}\n";
+        std::cout << "Trace: wrote " << events.size() << " events to " << path << "\n";
+        return (bool)file;
+    }
+
+    /**
+     * Drops every recorded event.
+     */
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        events.clear();
+    }
+
+private:
+    struct Event {
+        const char* category;
+        std::string name;
+        std::string detail;
+        int64_t start;
+        int64_t duration;
+        uint32_t thread;
+    };
+
+    std::atomic<bool> enabled{ false };
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    std::mutex mutex;
+    std::vector<Event> events;
+    std::vector<std::pair<uint32_t, std::string>> threadNames;
+    std::atomic<uint32_t> nextThreadId{ 1 };
+
+    Tracer() {}
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    // small sequential ids read better in the trace viewer than native thread ids
+    uint32_t getThreadId() {
+        thread_local uint32_t id = nextThreadId++;
+        return id;
+    }
+
+    static std::string escape(const std::string& text) {
+        std::string escaped;
+        escaped.reserve(text.size());
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+                escaped += c;
+            }
+            else if ((unsigned char)c < 0x20) {
+                char code[8];
+                std::snprintf(code, sizeof(code), "\\u%04x", (unsigned char)c);
+                escaped += code;
+            }
+            else
+                escaped += c;
+        }
+        return escaped;
+    }
+};
+
+/**
+ * Records the time from its construction to its destruction as a trace event, if tracing was enabled when it started.
+ */
+class TraceScope {
+public:
+    TraceScope(const char* category, const char* name, const std::string& detail)
+        : category(category), name(name), active(Tracer::instance().isEnabled()) {
+        if (active) {
+            this->detail = detail;
+            start = Tracer::instance().now();
+        }
+    }
+
+    // taking C strings as they are keeps a disabled scope from building a std::string out of its detail
+    TraceScope(const char* category, const char* name, const char* detail = nullptr)
+        : category(category), name(name), active(Tracer::instance().isEnabled()) {
+        if (active) {
+            if (detail)
+                this->detail = detail;
+            start = Tracer::instance().now();
+        }
+    }
+
+    ~TraceScope() {
+        if (active) {
+            Tracer& tracer = Tracer::instance();
+            tracer.record(category, name, std::move(detail), start, tracer.now() - start);
+        }
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* category;
+    const char* name;
+    std::string detail;
+    int64_t start = 0;
+    bool active;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+/**
+ * Traces the rest of the enclosing scope, e.g. TRACE_SCOPE("decode", "DecodeImage", path).
+ * The category and name must be string literals; the optional detail is any string, only copied while tracing.
+ */
+#define TRACE_SCOPE(category, ...) TraceScope TRACE_CONCAT(traceScope, __LINE__)(category, __VA_ARGS__)
@@ -0,0 +1,141 @@
+#pragma once
+#include <glad.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "GpuResource.h"
+#include "Shader.h"
+
+/**
+ * Camera data of a frame, laid out like the std140 "Camera" uniform block of the shaders:
+ *
+ *   layout (std140) uniform Camera { mat4 projection; mat4 view; vec4 cameraPosition; };
+ */
+struct CameraUniforms {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec4 position; // w is unused
+};
+static_assert(sizeof(CameraUniforms) == 144, "CameraUniforms must match the std140 layout of the Camera block");
+
+/**
+ * Uniform buffers shared by every program, bound at the binding points of UniformBlockBinding:
+ *
+ * - the camera of the frame, uploaded once per frame (or per impostor view while baking) instead of into each program;
+ * - the model matrices of the objects drawn, uploaded once per frame into blocks of TRANSFORMS_PER_BLOCK matrices.
+ *   Shaders read them as "layout (std140) uniform Transforms { mat4 models[256]; };" indexed by the "transformIndex"
+ *   uniform, so a draw only sets an index, and only binds another block when its transform is in a different one.
+ *
+ * OpenGL 3.3 has no shader storage buffers, so the transforms are split into blocks of the smallest uniform block size
+ * every driver supports (16 KB). Each upload orphans the buffer, so the driver can keep the previous frame's storage
+ * in flight instead of stalling on it. Must be used on the GL thread.
+ */
+class UniformBuffers {
+public:
+    // model matrices in one Transforms block; must match the size of the models array in the shaders
+    static const unsigned int TRANSFORMS_PER_BLOCK = 256;
+
+    /**
+     * Gets the buffers shared by the whole game.
+     */
+    static UniformBuffers& instance() {
+        static UniformBuffers buffers;
+        return buffers;
+    }
+
+    UniformBuffers(const UniformBuffers&) = delete;
+    UniformBuffers& operator=(const UniformBuffers&) = delete;
+
+    /**
+     * Uploads the camera every program reads through the Camera block.
+     */
+    void setCamera(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& position) {
+        create();
+        CameraUniforms camera;
+        camera.projection = projection;
+        camera.view = view;
+        camera.position = glm::vec4(position, 1.0f);
+        glBindBuffer(GL_UNIFORM_BUFFER, cameraBuffer.get());
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(camera), &camera);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    /**
+     * Uploads the model matrices of a frame, replacing the previous ones, and binds the block of the first one.
+     * Transform i is then read as models[getTransformIndex(i)] once getTransformBlock(i) is bound with bindTransformBlock().
+     */
+    void setTransforms(const std::vector<glm::mat4>& transforms) {
+        create();
+        size_t blocks = std::max<size_t>(1, (transforms.size() + TRANSFORMS_PER_BLOCK - 1) / TRANSFORMS_PER_BLOCK);
+        transformBlocks = std::max(transformBlocks, blocks);
+        size_t bytes = transformBlocks * blockStride;
+        glBindBuffer(GL_UNIFORM_BUFFER, transformBuffer.get());
+        glBufferData(GL_UNIFORM_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+        // the blocks are aligned to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, so each one is copied on its own
+        for (size_t first = 0; first < transforms.size(); first += TRANSFORMS_PER_BLOCK) {
+            size_t count = std::min<size_t>(TRANSFORMS_PER_BLOCK, transforms.size() - first);
+            glBufferSubData(GL_UNIFORM_BUFFER, (first / TRANSFORMS_PER_BLOCK) * blockStride, count * sizeof(glm::mat4), &transforms[first]);
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        transformBuffer.setMemory(bytes, GPU_UNIFORM_BUFFER);
+        bindTransformBlock(0);
+    }
+
+    /**
+     * Binds a block of the transforms uploaded by setTransforms() to the Transforms block of the shaders.
+     */
+    void bindTransformBlock(unsigned int block) {
+        glBindBufferRange(GL_UNIFORM_BUFFER, UNIFORM_BLOCK_TRANSFORMS, transformBuffer.get(),
+                          (GLintptr)(block * blockStride), (GLsizeiptr)(TRANSFORMS_PER_BLOCK * sizeof(glm::mat4)));
+    }
+
+    /**
+     * Gets the block holding a transform, and its index in the block, for the transformIndex uniform.
+     */
+    static unsigned int getTransformBlock(uint32_t transform) {
+        return transform / TRANSFORMS_PER_BLOCK;
+    }
+
+    static int getTransformIndex(uint32_t transform) {
+        return (int)(transform % TRANSFORMS_PER_BLOCK);
+    }
+
+    /**
+     * Deletes the buffers. Call before the GL context is destroyed; they are created again if used afterwards.
+     */
+    void release() {
+        cameraBuffer.reset();
+        transformBuffer.reset();
+        transformBlocks = 0;
+    }
+
+private:
+    GLBuffer cameraBuffer;
+    GLBuffer transformBuffer;
+    size_t transformBlocks = 0; // blocks the transform buffer has room for
+    size_t blockStride = 0;     // bytes from one block to the next
+
+    UniformBuffers() {}
+
+    // creates the buffers and binds the camera for good, on first use
+    void create() {
+        if (cameraBuffer)
+            return;
+        cameraBuffer = GLBuffer::create();
+        glBindBuffer(GL_UNIFORM_BUFFER, cameraBuffer.get());
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraUniforms), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        cameraBuffer.setMemory(sizeof(CameraUniforms), GPU_UNIFORM_BUFFER);
+        cameraBuffer.setOwner("uniform buffers");
+        glBindBufferBase(GL_UNIFORM_BUFFER, UNIFORM_BLOCK_CAMERA, cameraBuffer.get());
+
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        alignment = std::max(alignment, 1);
+        size_t blockBytes = TRANSFORMS_PER_BLOCK * sizeof(glm::mat4);
+        blockStride = (blockBytes + alignment - 1) / alignment * alignment;
+        transformBuffer = GLBuffer::create();
+        transformBuffer.setOwner("uniform buffers");
+    }
+};
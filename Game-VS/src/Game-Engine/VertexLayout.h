@@ -0,0 +1,130 @@
+#pragma once
+#include <glad.h>
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <glm/packing.hpp>
+#include <glm/gtc/packing.hpp>
+
+/**
+ * Encasulation of all data for a vertex used by Mesh
+ * source: https://learnopengl.com/Model-Loading/Mesh
+ */
+struct Vertex {
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+    glm::vec3 Tangent;
+    glm::vec3 Bitangent;
+};
+
+/**
+ * Compact GPU vertex: 24 bytes instead of the 56 of Vertex. Normal and tangent are stored as signed normalized
+ * 2_10_10_10 integers and the texture coordinates as half floats. The bitangent isn't stored; the tangent's w holds
+ * its sign, so shaders that need it can use cross(normal, tangent.xyz) * tangent.w.
+ */
+struct PackedVertex {
+    glm::vec3 Position;
+    uint32_t Normal;    // GL_INT_2_10_10_10_REV, w unused
+    uint32_t TexCoords; // two GL_HALF_FLOATs
+    uint32_t Tangent;   // GL_INT_2_10_10_10_REV, w = bitangent sign
+};
+
+/**
+ * Vertex formats a Mesh can upload its vertices in.
+ */
+enum VertexFormat {
+    VERTEX_FULL,   // Vertex, every attribute as 32-bit floats
+    VERTEX_PACKED  // PackedVertex
+};
+
+/**
+ * One vertex attribute, as passed to glVertexAttribPointer.
+ */
+struct VertexAttribute {
+    GLuint location;
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    size_t offset;
+};
+
+/**
+ * Compile-time description of the attributes of a vertex type. Locations match the model shaders:
+ * 0 = position, 1 = normal, 2 = texture coordinates, 3 = tangent, 4 = bitangent.
+ */
+template <typename V>
+struct VertexLayout;
+
+template <>
+struct VertexLayout<Vertex> {
+    static constexpr VertexFormat FORMAT = VERTEX_FULL;
+    static constexpr VertexAttribute ATTRIBUTES[] = {
+        { 0, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Position) },
+        { 1, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Normal) },
+        { 2, 2, GL_FLOAT, GL_FALSE, offsetof(Vertex, TexCoords) },
+        { 3, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Tangent) },
+        { 4, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, Bitangent) }
+    };
+};
+
+template <>
+struct VertexLayout<PackedVertex> {
+    static constexpr VertexFormat FORMAT = VERTEX_PACKED;
+    // packed 2_10_10_10 attributes always have 4 components; the shaders' vec3 inputs just drop w
+    static constexpr VertexAttribute ATTRIBUTES[] = {
+        { 0, 3, GL_FLOAT, GL_FALSE, offsetof(PackedVertex, Position) },
+        { 1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(PackedVertex, Normal) },
+        { 2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex, TexCoords) },
+        { 3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(PackedVertex, Tangent) }
+    };
+
+    // half floats lose sub-texel precision quickly beyond this range, so meshes with larger (tiled) coordinates stay unpacked
+    static constexpr float MAX_TEXCOORD = 2.0f;
+};
+
+static_assert(sizeof(Vertex) == 56, "Vertex is expected to be tightly packed");
+static_assert(sizeof(PackedVertex) == 24, "PackedVertex is expected to be tightly packed");
+
+/**
+ * Enables and points every attribute of a vertex type at the currently bound GL_ARRAY_BUFFER, for the currently bound VAO.
+ */
+template <typename V>
+inline void SetupVertexAttributes() {
+    for (const VertexAttribute& attribute : VertexLayout<V>::ATTRIBUTES) {
+        glEnableVertexAttribArray(attribute.location);
+        glVertexAttribPointer(attribute.location, attribute.size, attribute.type, attribute.normalized, sizeof(V), (void*)attribute.offset);
+    }
+}
+
+/**
+ * Checks if the texture coordinates of a mesh can be stored as half floats without visible loss of precision.
+ */
+inline bool FitsPackedVertex(const Vertex* vertices, size_t numVertices) {
+    for (size_t i = 0; i < numVertices; i++)
+        if (std::abs(vertices[i].TexCoords.x) > VertexLayout<PackedVertex>::MAX_TEXCOORD ||
+            std::abs(vertices[i].TexCoords.y) > VertexLayout<PackedVertex>::MAX_TEXCOORD)
+            return false;
+    return true;
+}
+
+/**
+ * Converts a vertex to the packed format.
+ */
+inline PackedVertex PackVertex(const Vertex& vertex) {
+    auto normalized = [](const glm::vec3& v) {
+        float length = glm::length(v);
+        return length > 0.0f ? v / length : glm::vec3(0.0f);
+    };
+    glm::vec3 normal = normalized(vertex.Normal);
+    glm::vec3 tangent = normalized(vertex.Tangent);
+    float bitangentSign = glm::dot(glm::cross(normal, tangent), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+
+    PackedVertex packed;
+    packed.Position = vertex.Position;
+    packed.Normal = glm::packSnorm3x10_1x2(glm::vec4(normal, 0.0f));
+    packed.TexCoords = glm::packHalf2x16(vertex.TexCoords);
+    packed.Tangent = glm::packSnorm3x10_1x2(glm::vec4(tangent, bitangentSign));
+    return packed;
+}
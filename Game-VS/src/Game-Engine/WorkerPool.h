@@ -0,0 +1,101 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <vector>
+#include "Trace.h"
+
+/**
+ * Fixed-size pool of worker threads that run submitted jobs in FIFO order.
+ * Jobs must not make OpenGL calls, since the GL context belongs to the main thread.
+ */
+class WorkerPool {
+public:
+    /**
+     * Starts the provided number of worker threads (at least one).
+     */
+    explicit WorkerPool(unsigned int numThreads = defaultThreadCount()) {
+        if (numThreads == 0)
+            numThreads = 1;
+        for (unsigned int i = 0; i < numThreads; i++)
+            workers.emplace_back([this]() { workerLoop(); });
+    }
+
+    /**
+     * Finishes the jobs already queued, then stops and joins all worker threads.
+     */
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        jobAvailable.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    /**
+     * Queues a job to be run on one of the worker threads.
+     */
+    void submit(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        jobAvailable.notify_one();
+    }
+
+    unsigned int getThreadCount() const {
+        return (unsigned int)workers.size();
+    }
+
+    /**
+     * Checks if the calling thread is a worker of any pool. Jobs use it to stay single threaded, since the other
+     * workers already keep the cores busy.
+     */
+    static bool isWorkerThread() {
+        return workerThread();
+    }
+
+    /**
+     * One thread per core, leaving one core for the main (GL) thread.
+     */
+    static unsigned int defaultThreadCount() {
+        unsigned int cores = std::thread::hardware_concurrency();
+        return cores > 1 ? cores - 1 : 1;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    bool stopping = false;
+
+    static bool& workerThread() {
+        thread_local bool worker = false;
+        return worker;
+    }
+
+    void workerLoop() {
+        workerThread() = true;
+        Tracer::instance().setThreadName("worker");
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (jobs.empty())
+                    return; // stopping and nothing left to do
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+};
@@ -19,6 +19,17 @@
 #include "Game-Engine/Shader.h"
 #include "Game-Engine/Model.h"
 #include "Game-Engine/CharacterCamera.h"
+#include "Game-Engine/AssetLoader.h"
+#include "Game-Engine/ModelRegistry.h"
+#include "Game-Engine/ImpostorAtlas.h"
+#include "Game-Engine/TextureArrayPacker.h"
+#include "Game-Engine/ProcessMemory.h"
+#include "Game-Engine/GpuResource.h"
+#include "Game-Engine/Trace.h"
+#include "Game-Engine/Scene.h"
+#include "Game-Engine/RenderQueue.h"
+#include "Game-Engine/UniformBuffers.h"
+#include "Game-Engine/Frustum.h"
 #include "Audio-Engine/AudioEngine.h"
 #include "Audio-Engine/FootstepSoundController.h"
 #include "Audio-Engine/CoinChallengeSoundController.h"
@@ -42,8 +53,8 @@ float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 float currentFrame = 0.0f;
 
-// Character/camera data
-CharacterCamera camera(STARTING_PLAYER_LOCATION);
+// Character/camera data, placed at the scene's player start
+CharacterCamera camera;
 float lastX = SCREEN_WIDTH / 2.0f;
 float lastY = SCREEN_HEIGHT / 2.0f;
 bool firstMouse = true;
@@ -53,6 +64,27 @@ std::vector<GameObject*> gameObjects;
 std::vector<Animation*> animationObjects;
 std::vector<InstancedObject*> instancedObjects;
 std::vector<Coin*> coins;
+NPC* npc = nullptr;
+
+// Placement of all game objects and sound emitters, which keeps the model and sound paths they point to
+SceneFile scene;
+
+// Background model loading and texture streaming
+std::unique_ptr<AssetLoader> assetLoader;
+std::unique_ptr<TextureStreamer> textureStreamer;
+float assetLoadStartTime = 0.0f;
+bool assetsLoaded = false;
+
+// Level of detail selection of game objects, and impostors for the distant vegetation
+LODSelector lodSelector(LOD_SCREEN_SIZES, sizeof(LOD_SCREEN_SIZES) / sizeof(LOD_SCREEN_SIZES[0]), LOD_HYSTERESIS);
+std::unique_ptr<ImpostorAtlas> impostorAtlas;
+// Texture arrays the model textures are packed into once loaded
+std::unique_ptr<TextureArrayPacker> textureArrayPacker;
+// Draws of the game objects, sorted by state each frame; its depth range is the far plane of getProjection()
+RenderQueue renderQueue(100.0f);
+// Culls the game objects against the camera's view frustum every frame
+FrustumCuller frustumCuller;
+bool renderStatsPrinted = false;
 
 // Audio Engine
 std::shared_ptr<AudioEngine> audioEngine;
@@ -86,27 +118,14 @@ static glm::mat4 getProjection() {
 	return glm::perspective(glm::radians(camera.Zoom), (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT, 0.1f, 100.0f);
 }
 
-/**
- *  Performs the OpenGL calls to render a GameObject with a provided shader.
- */
-static void renderGameObject(GameObject &gameObject, Shader* shader) {
-	// enable shader before setting uniforms
-	shader->use();
-	// view/projection transformations
-	glm::mat4 projection = getProjection();
-	glm::mat4 view = camera.GetViewMatrix();
-	shader->setMat4("projection", projection);
-	shader->setMat4("view", view);
-	// render the loaded model
-	shader->setMat4("model", gameObject.getModel());
-	gameObject.draw(shader);
-}
-
 /**
  * Main program entry point which contains the OpenGL Loop.
  */
 int main()
 {
+	// trace the cold start, up to every asset being loaded
+	Tracer::instance().setEnabled(TRACE_ASSET_LOADING);
+	Tracer::instance().setThreadName("main");
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -142,149 +161,96 @@ int main()
 	// configure global opengl state
 	glEnable(GL_DEPTH_TEST);
 
+	// track the GPU memory of every buffer, texture and program created from here on
+	GpuResourceRegistry::instance().setBudget(GPU_MEMORY_BUDGET_MB * 1024 * 1024);
+
 	// build and compile shaders
 	Shader gameObjectShader("res/shaders/1.model_loading.vs", "res/shaders/1.model_loading.fs");
 	Shader* instancedObjectShader = new Shader("res/shaders/instanced_model_loading.vs", "res/shaders/instanced_model_loading.fs");
+	Shader impostorShader("res/shaders/impostor.vs", "res/shaders/impostor.fs");
+
+	// load the models of all shared game objects on worker threads; they're uploaded from the render loop
+	assetLoader = std::make_unique<AssetLoader>();
+	ModelRegistry::instance().setAsyncLoader(assetLoader.get());
+	// cook textures into block compressed files on first use, and map those on later runs
+	TextureCache::instance().setCompression(COMPRESS_TEXTURES && TextureCooker::isSupported());
+	// textures start out as placeholders and are streamed in as they are decoded
+	textureStreamer = std::make_unique<TextureStreamer>(assetLoader->getWorkerPool());
+	TextureCache::instance().setStreamer(textureStreamer.get());
+	// only load the texture types the shaders actually sample
+	ModelRegistry::instance().setTargetShader(MODEL_SHARED, &gameObjectShader);
+	ModelRegistry::instance().setTargetShader(MODEL_INSTANCED, instancedObjectShader);
+	// both model shaders only read positions, normals and texture coordinates, which the packed vertex format keeps
+	ModelRegistry::instance().setVertexFormat(MODEL_SHARED, VERTEX_FORMAT);
+	ModelRegistry::instance().setVertexFormat(MODEL_INSTANCED, VERTEX_FORMAT);
+	// nothing reads mesh vertices after the upload; keep only the bounds and a coarse collision proxy
+	ModelRegistry::instance().setResidency(MODEL_SHARED, RESIDENCY_KEEP_BOUNDS);
+	ModelRegistry::instance().setResidency(MODEL_INSTANCED, RESIDENCY_KEEP_BOUNDS);
+	assetLoadStartTime = glfwGetTime();
 
 	/*
-		Initialize game objects and add to list
+		Initialize game objects from the scene, all instances of a model at a time
 	*/
-	GameObject* fountain = new GameObject(OBJ_FOUNTAIN, tranFountain, scaleFountain, rotFountain);
-	GameObject* house = new GameObject(OBJ_HOUSE, tranHouse, scaleHouse, rotHouse);
-	GameObject* rock = new GameObject(OBJ_ROCK, tranRock, scaleRock, rotRock);
-	GameObject* ground = new GameObject(OBJ_GROUND, tranGround, scaleGround, rotGround);
-	//GameObject* grass = new GameObject(OBJ_GRASS, tranGrass, scaleGrass, rotGrass);
-	GameObject* cooltree = new GameObject(OBJ_COOLTREE, tranCooltree, scaleCooltree, rotCooltree);
-	GameObject* oak = new GameObject(OBJ_OAK, tranPine, scalePine, rotPine);
-	GameObject* house2 = new GameObject(OBJ_HOUSE2, tranHouse2, scaleHouse2, rotHouse2);
-	//GameObject* japaneseTree = new GameObject(OBJ_JAPANESE_TREE, tranJapaneseTree, scaleJapaneseTree, rotJapaneseTree);
-	GameObject* cottage = new GameObject(OBJ_COTTAGE, tranCottage, scaleCottage, rotCottage);
-	GameObject* cottage1 = new GameObject(OBJ_COTTAGE, tranCottage1, scaleCottage1, rotCottage1);
-	GameObject* cottage2 = new GameObject(OBJ_COTTAGE, tranCottage2, scaleCottage2, rotCottage2);
-	GameObject* willowtree = new GameObject(OBJ_WILLOWTREE, tranWillowtree, scaleWillowtree, rotWillowtree);
-	GameObject* well = new GameObject(OBJ_WELL, tranWell, scaleWell, rotWell);
-	GameObject* townhouse = new GameObject(OBJ_TOWNHOUSE, tranGreenPine, scaleGreenPine, rotGreenPine);
-	GameObject* townhouse1 = new GameObject(OBJ_TOWNHOUSE, tranGreenPine1, scaleGreenPine1, rotGreenPine1);
-	GameObject* fir1 = new GameObject(OBJ_OAK, tranfir1, scalefir1, rotfir1);
-	GameObject* fir2 = new GameObject(OBJ_OAK, tranfir2, scalefir2, rotfir2);
-	GameObject* fir3 = new GameObject(OBJ_OAK, tranfir3, scalefir3, rotfir3);
-	GameObject* house3 = new GameObject(OBJ_HOUSE3, tranHouse, scaleHouse, rotHouse);
-	GameObject* backhouse2 = new GameObject(OBJ_HOUSE3, tranHouseback2, scaleHouseback2, rotHouseback2);
-	GameObject* japaneseTree2 = new GameObject(OBJ_JAPANESE_TREE2, tranJapaneseTree2, scaleJapaneseTree2, rotJapaneseTree2);
-	GameObject* japaneseTree3 = new GameObject(OBJ_JAPANESE_TREE2, tranJapaneseTree3, scaleJapaneseTree2, rotJapaneseTree2);
-	GameObject* fir4 = new GameObject(OBJ_TREE_BUSH, tranfir4, scalefir4, rotfir4);
-	GameObject* fir5 = new GameObject(OBJ_OAK, tranfir5, scalefir5, rotfir5);
-	GameObject* fir6 = new GameObject(OBJ_OAK, tranfir6, scalefir6, rotfir6);
-	GameObject* fir7 = new GameObject(OBJ_OAK, tranfir7, scalefir7, rotfir7);
-	GameObject* fir8 = new GameObject(OBJ_OAK, tranfir8, scalefir8, rotfir8);
-	GameObject* fir9 = new GameObject(OBJ_OAK, tranfir9, scalefir9, rotfir9);
-	GameObject* fir10 = new GameObject(OBJ_OAK, tranfir10, scalefir9, rotfir9);
-	GameObject* fir11 = new GameObject(OBJ_OAK, tranfir11, scalefir9, rotfir9);
-	GameObject* fir12 = new GameObject(OBJ_OAK, tranfir12, scalefir9, rotfir9);
-	GameObject* house4 = new GameObject(OBJ_HOUSE4, tranHouse4, scaleHouse4, rotHouse4);
-	GameObject* house5 = new GameObject(OBJ_HOUSE4, tranHouse5, scaleHouse4, rotHouse5);
-	GameObject* tree_bush = new GameObject(OBJ_TREE_BUSH, tranbush, scalebush, rotbush);
-	GameObject* tree_bush_1 = new GameObject(OBJ_TREE_BUSH, tranbush1, scalebush1, rotbush1);
-	GameObject* tree_bush_2 = new GameObject(OBJ_TREE_BUSH, tranbush2, scalebush2, rotbush2);
-	GameObject* backfir1 = new GameObject(OBJ_OAK, tranfirback1, scalefirback1, rotfirback1);
-	GameObject* backfir2 = new GameObject(OBJ_OAK, tranfirback2, scalefirback2, rotfirback2);
-	GameObject* backfir3 = new GameObject(OBJ_OAK, tranfirback3, scalefirback3, rotfirback3);
-	GameObject* backfir5 = new GameObject(OBJ_OAK, tranfirback5, scalefirback5, rotfirback5);
-	GameObject* backfir6 = new GameObject(OBJ_OAK, tranfirback6, scalefirback6, rotfirback6);
-	GameObject* backfir7 = new GameObject(OBJ_OAK, tranfirback7, scalefirback7, rotfirback7);
-	GameObject* backfir8 = new GameObject(OBJ_OAK, tranfirback8, scalefirback8, rotfirback8);
-	GameObject* backfir9 = new GameObject(OBJ_OAK, tranfirback9, scalefirback9, rotfirback9);
-	GameObject* treeline = new GameObject(OBJ_TREE_LINE, trantreeline, scaletreeline, rottreeline);
-	GameObject* treeline1 = new GameObject(OBJ_TREE_LINE, trantreeline1, scaletreeline1, rottreeline1);
-	GameObject* treeline2 = new GameObject(OBJ_TREE_LINE, trantreeline2, scaletreeline2, rottreeline2);
-	GameObject* treeline3 = new GameObject(OBJ_TREE_LINE, trantreeline3, scaletreeline3, rottreeline3);
-	GameObject* treeline4 = new GameObject(OBJ_TREE_LINE, trantreeline4, scaletreeline4, rottreeline4);
-	GameObject* treeline5 = new GameObject(OBJ_TREE_LINE, trantreeline5, scaletreeline4, rottreeline4);
-	GameObject* tree_bush_4 = new GameObject(OBJ_TREE_BUSH, tranbushback4, scalebushback4, rotbushback4);
-	GameObject* tree_bush_5 = new GameObject(OBJ_TREE_BUSH, tranbushback5, scalebushback5, rotbushback5);
-	GameObject* tree_bush_6 = new GameObject(OBJ_OAK, tranbush6, scalebush6, rotbush6);
-	
-	// List for all game objects
-	gameObjects.push_back(fountain);
-	gameObjects.push_back(house3);
-	gameObjects.push_back(ground);
-	gameObjects.push_back(rock);
-	gameObjects.push_back(cooltree);
-	gameObjects.push_back(oak);
-	gameObjects.push_back(house2);
-	gameObjects.push_back(cottage);
-	gameObjects.push_back(cottage1);
-	gameObjects.push_back(cottage2);
-	gameObjects.push_back(willowtree);
-	gameObjects.push_back(well);
-	gameObjects.push_back(townhouse);
-	gameObjects.push_back(townhouse1);
-	gameObjects.push_back(japaneseTree2);
-	gameObjects.push_back(japaneseTree3);
-	gameObjects.push_back(fir1);
-	gameObjects.push_back(fir2);
-	gameObjects.push_back(fir3);
-	gameObjects.push_back(fir4);
-	gameObjects.push_back(fir5);
-	gameObjects.push_back(fir6);
-	gameObjects.push_back(fir7);
-	gameObjects.push_back(fir8);
-	gameObjects.push_back(fir9);
-	gameObjects.push_back(fir10);
-	gameObjects.push_back(fir11);
-	gameObjects.push_back(fir12);
-	gameObjects.push_back(house4);
-	gameObjects.push_back(house5);
-	gameObjects.push_back(backhouse2);
-    gameObjects.push_back(tree_bush);
-	gameObjects.push_back(tree_bush_1);
-	gameObjects.push_back(tree_bush_2);
-	gameObjects.push_back(backfir1);
-	gameObjects.push_back(backfir2);
-	gameObjects.push_back(backfir3);
-	gameObjects.push_back(backfir5);
-	gameObjects.push_back(backfir6);
-	gameObjects.push_back(backfir7);
-	gameObjects.push_back(backfir8);
-	gameObjects.push_back(backfir9);
-	gameObjects.push_back(treeline);
-	gameObjects.push_back(treeline1);
-	gameObjects.push_back(treeline2);
-	gameObjects.push_back(treeline3);
-	gameObjects.push_back(treeline4);
-	gameObjects.push_back(treeline5);
-	gameObjects.push_back(tree_bush_4);
-	gameObjects.push_back(tree_bush_5);
-	gameObjects.push_back(tree_bush_6);
-
-    /*
-        Initialize and store animatable game objects 
-    */
-
-    Bird* birds = new Bird(OBJ_BIRDS, tranBirds, scaleBirds, rotBirds);
-    Harp* harp  = new Harp(OBJ_HARP, tranHarp, scaleHarp, rotHarp);
-	NPC* npc    = new NPC (OBJ_YUN, tranNPC, scaleNPC, rotNPC, 5.0f);
-    gameObjects.push_back(birds);
-    gameObjects.push_back(harp);
-	gameObjects.push_back(npc);
-
-    // add to list of animation objects which need to be updated each frame
-    animationObjects.push_back(birds);
-    animationObjects.push_back(harp);
-	
-    // Load all animated coins and add to game objects, animation objects, and coin list
-	for (auto trans : coinTranslations) {
-		Coin* coin = new Coin(OBJ_COIN, trans, scaleCoins, rotCoins);
-		coin->setDestroyed(true);
-        gameObjects.push_back(coin);
-        animationObjects.push_back(coin);
-        coins.push_back(coin);
+	std::string sceneError;
+	if (!scene.load(SCENE_FILE, &sceneError)) {
+		std::cout << "Failed to load scene: " << sceneError << std::endl;
+		glfwTerminate();
+		return -1;
+	}
+	std::cout << (scene.wasCompiled() ? "Compiled scene " : "Mapped scene ") << SCENE_FILE << ": " << scene.getObjectCount()
+	          << " objects of " << scene.getAssetCount() << " assets, " << scene.getEmitterCount() << " sound emitters\n";
+	camera.Position = scene.getPlayerStart();
+
+	// the back firs and tree lines are drawn as impostors once they are far enough away
+	impostorAtlas = std::make_unique<ImpostorAtlas>(IMPOSTOR_DISTANCE);
+	gameObjects.reserve(scene.getObjectCount());
+	for (uint32_t a = 0; a < scene.getAssetCount(); a++) {
+		const SceneAsset& asset = scene.getAsset(a);
+		// the scene keeps its strings for as long as it's loaded, so objects can keep the path
+		const char* path = scene.getString(asset.pathOffset);
+		for (uint32_t i = asset.firstObject; i < asset.firstObject + asset.objectCount; i++) {
+			const SceneObject& object = scene.getObject(i);
+			switch (object.type) {
+			case SCENE_OBJECT_BIRD: {
+				Bird* birds = new Bird(path, object.translation, object.scale, object.rotation);
+				gameObjects.push_back(birds);
+				animationObjects.push_back(birds);
+				break;
+			}
+			case SCENE_OBJECT_HARP: {
+				Harp* harp = new Harp(path, object.translation, object.scale, object.rotation);
+				gameObjects.push_back(harp);
+				animationObjects.push_back(harp);
+				break;
+			}
+			case SCENE_OBJECT_NPC:
+				npc = new NPC(path, object.translation, object.scale, object.rotation, object.colliderRadius);
+				gameObjects.push_back(npc);
+				break;
+			case SCENE_OBJECT_COIN: {
+				// coins stay hidden until the coin challenge starts
+				Coin* coin = new Coin(path, object.translation, object.scale, object.rotation, object.colliderRadius);
+				coin->setDestroyed(true);
+				gameObjects.push_back(coin);
+				animationObjects.push_back(coin);
+				coins.push_back(coin);
+				break;
+			}
+			default: {
+				GameObject* gameObject = new GameObject(path, object.translation, object.scale, object.rotation);
+				gameObjects.push_back(gameObject);
+				if (object.flags & SCENE_OBJECT_IMPOSTOR)
+					impostorAtlas->addObject(gameObject);
+				break;
+			}
+			}
+		}
 	}
 
 	// Scale all objects Size and Translation
 	for (auto gameObject : gameObjects) {
-		gameObject->setScale(gameObject->getScale() * GLOBAL_SCALE);
-		gameObject->setTranslation(gameObject->getTranslation()* GLOBAL_POSITION_SCALE);
+		gameObject->setScale(gameObject->getScale() * scene.getGlobalScale());
+		gameObject->setTranslation(gameObject->getTranslation() * scene.getPositionScale());
 	}
 
 
@@ -292,7 +258,7 @@ int main()
 		Initialize instanced game objects
 	*/
 
-	Grass* grass = new Grass(OBJ_GRASS, instancedObjectShader);
+	Grass* grass = new Grass(OBJ_GRASS, instancedObjectShader, scaleGrass * scene.getGlobalScale());
 	instancedObjects.push_back(grass);
 	
 	/*
@@ -302,20 +268,28 @@ int main()
 	audioEngine = std::make_shared<AudioEngine>();
 	audioEngine->init();
 	
-	// load sounds
-	audioEngine->loadSound(fountainSoundLoop);
-	audioEngine->loadSound(soundTree);
-	audioEngine->loadSound(soundJapaneseTree);
-	audioEngine->loadSound(dialogue);
+	// load the sounds of the scene's emitters
+	std::vector<SoundInfo> sounds;
+	sounds.reserve(scene.getEmitterCount());
+	for (uint32_t i = 0; i < scene.getEmitterCount(); i++) {
+		const SceneEmitter& emitter = scene.getEmitter(i);
+		glm::vec3 position = emitter.position * scene.getPositionScale();
+		sounds.emplace_back(scene.getString(emitter.pathOffset), emitter.volume, emitter.reverb, emitter.loop ? SOUND_LOOP : SOUND_ONE_SHOT,
+		                    emitter.positional ? SOUND_3D : SOUND_2D, position.x, position.y, position.z);
+		audioEngine->loadSound(sounds.back());
+	}
+	// the NPC's line, played when the player first walks up to them
+	const SceneEmitter* dialogueEmitter = scene.findEmitter(DIALOGUE_EMITTER);
+	SoundInfo* dialogue = dialogueEmitter ? &sounds[dialogueEmitter - &scene.getEmitter(0)] : nullptr;
 	
 	// setup sound controllers
 	footstepController = new FootstepSoundController(audioEngine);
 	coinSoundController = new CoinChallengeSoundController(audioEngine, coins.size());
 
 	// Start inital soundscape
-	audioEngine->playSound(soundTree);
-	audioEngine->playSound(soundJapaneseTree);
-	audioEngine->playSound(fountainSoundLoop);
+	for (SoundInfo& sound : sounds)
+		if (sound.isLoop())
+			audioEngine->playSound(sound);
 	
     
     /* render loop */ 
@@ -327,6 +301,33 @@ int main()
 		lastFrame = currentFrame;
 
         ProcessInput(window);
+
+		// upload models finished by the asset loader and streamed textures, without spending more than the frame's budget on it
+		if (!assetLoader->isIdle())
+			assetLoader->processUploads(ASSET_UPLOAD_BUDGET_MS);
+		TextureCache::instance().processStreaming(TEXTURE_UPLOAD_BUDGET_MS);
+		if (!assetsLoaded && assetLoader->isIdle() && TextureCache::instance().getStreamingCount() == 0) {
+			assetsLoaded = true;
+			std::cout << "All models loaded in " << currentFrame - assetLoadStartTime << " seconds\n";
+			// report how many duplicate model loads were avoided by sharing
+			ModelRegistry::instance().printStats();
+			TextureCache::instance().printStats();
+			std::cout << "Process memory: " << GetResidentBytes() / (1024 * 1024) << " MB resident\n";
+			std::cout << "Shader programs: " << ProgramCache::getHits() << " loaded from the program cache, "
+			          << ProgramCache::getMisses() + ProgramCache::getRejected() << " compiled (" << ProgramCache::getRejected() << " rejected by the driver)\n";
+			// textures sharing a size and format become layers of one array, so most meshes draw without a texture bind
+			if (PACK_TEXTURE_ARRAYS) {
+				textureArrayPacker = std::make_unique<TextureArrayPacker>();
+				textureArrayPacker->pack(ModelRegistry::instance().getLiveModels());
+			}
+			// the impostors are pictures of the models, so they can only be taken once every texture is in
+			impostorAtlas->bake(gameObjectShader);
+			GpuResourceRegistry::instance().printStats();
+			if (Tracer::instance().isEnabled()) {
+				Tracer::instance().setEnabled(false);
+				Tracer::instance().write(TRACE_FILE);
+			}
+		}
 		
 		glClearColor(COLOR_SKY.x, COLOR_SKY.y, COLOR_SKY.z, COLOR_SKY.w);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -347,11 +348,11 @@ int main()
         }
 
 		// Collision detection for dialogue triggering
-		if (!npc->hasSaidDialogueLine()) {
+		if (npc && dialogue && !npc->hasSaidDialogueLine()) {
 			if (npc->collidesWithSphere(camera)) {
-				audioEngine->playSound(dialogue);
+				audioEngine->playSound(*dialogue);
 				npc->setHasSaidDialogueLine(true);
-				unsigned int lengthMS = audioEngine->getSoundLengthInMS(dialogue);
+				unsigned int lengthMS = audioEngine->getSoundLengthInMS(*dialogue);
 				std::cout << "Before thread, length MS = " << lengthMS << '\n';
 				std::thread thd(waitForDialogueCompletion, lengthMS);
 				thd.detach();
@@ -362,13 +363,43 @@ int main()
         for (int i = 0; i < animationObjects.size(); i++)
             animationObjects[i]->update(currentFrame);
 
-        // render Game Objects
-        for (int i = 0; i < gameObjects.size(); i++) 
-            renderGameObject(*gameObjects[i], &gameObjectShader);
+        // every program reads the camera from the same uniform buffer, uploaded once per frame
+        glm::mat4 projection = getProjection();
+        glm::mat4 view = camera.GetViewMatrix();
+        UniformBuffers::instance().setCamera(projection, view, camera.Position);
+
+        // cull the Game Objects against the view frustum by their world space bounds
+        frustumCuller.begin(projection, view);
+        for (GameObject* gameObject : gameObjects) {
+            gameObject->updateBounds();
+            frustumCuller.add(gameObject->getWorldBoundsMin(), gameObject->getWorldBoundsMax());
+        }
+        frustumCuller.cull();
+
+        // render the visible Game Objects, except the distant ones drawn as impostors, at the level of detail matching their
+        // size on screen; the queue sorts their meshes by program, texture and vertex array to skip redundant state changes
+        impostorAtlas->update(camera.Position);
+        renderQueue.begin(camera.Position);
+        for (size_t i = 0; i < gameObjects.size(); i++) {
+            FrustumTest visibility = frustumCuller.getResult(i);
+            if (visibility == FRUSTUM_OUTSIDE)
+                continue;
+            gameObjects[i]->updateLOD(lodSelector, camera.Position, glm::radians(camera.Zoom));
+            // the meshes of an object on the edge of the view are culled one by one
+            const Frustum* meshFrustum = visibility == FRUSTUM_INTERSECTS ? &frustumCuller.getFrustum() : nullptr;
+            gameObjects[i]->enqueue(renderQueue, &gameObjectShader, meshFrustum, &frustumCuller.getStats());
+        }
+        renderQueue.submit();
+        if (assetsLoaded && !renderStatsPrinted) {
+            frustumCuller.printStats();
+            renderQueue.printStats();
+            renderStatsPrinted = true;
+        }
+        impostorAtlas->draw(impostorShader);
         
         // render instanced objects
         for(InstancedObject *instancedObject : instancedObjects)
-            instancedObject->drawInstances(getProjection(), camera.GetViewMatrix());
+            instancedObject->drawInstances();
        
 		/*
             Audio Engine per-frame updates
@@ -386,6 +417,28 @@ int main()
         glfwPollEvents();
     }
 
+    // the streaming buffers have to be released while the GL context still exists, and the loader's worker threads
+    // stopped before the texture cache they decode into is destroyed
+    TextureCache::instance().setStreamer(nullptr);
+    textureStreamer.reset();
+    assetLoader.reset();
+    impostorAtlas.reset();
+    textureArrayPacker.reset();
+    UniformBuffers::instance().release();
+
+    // release the scene while the GL context still exists: the last object using a model frees its buffers
+    for (GameObject* gameObject : gameObjects)
+        delete gameObject;
+    for (InstancedObject* instancedObject : instancedObjects)
+        delete instancedObject;
+    gameObjects.clear();
+    animationObjects.clear();
+    instancedObjects.clear();
+    coins.clear();
+    // whatever is left (shared textures, shaders) is freed along with the context
+    GpuResourceRegistry::instance().printStats();
+    GpuResourceRegistry::instance().releaseContext();
+
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
     glfwTerminate();
@@ -449,61 +502,61 @@ void ProcessInput(GLFWwindow* window)
 
 	// Number Keys: Coin Controls TODO fix collision detection so that these controls aren't needed
 	if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS && keyCanRetrigger(currentFrame, key1LastTime)) {
-		if (!coins[0]->isDestroyed()) {
+		if (coins.size() > 0 && !coins[0]->isDestroyed()) {
 			coins[0]->setDestroyed(true);
 			coinSoundController->characterPickedUpCoin();
 		}
 	}
 	if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS && keyCanRetrigger(currentFrame, key2LastTime)) {
-		if (!coins[1]->isDestroyed()) {
+		if (coins.size() > 1 && !coins[1]->isDestroyed()) {
 			coins[1]->setDestroyed(true);
 			coinSoundController->characterPickedUpCoin();
 		}
 	}	
 	if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS && keyCanRetrigger(currentFrame, key3LastTime)) {
-		if (!coins[2]->isDestroyed()) {
+		if (coins.size() > 2 && !coins[2]->isDestroyed()) {
 			coins[2]->setDestroyed(true);
 			coinSoundController->characterPickedUpCoin();
 		}
 	}
 	if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS && keyCanRetrigger(currentFrame, key4LastTime)) {
-		if (!coins[3]->isDestroyed()) {
+		if (coins.size() > 3 && !coins[3]->isDestroyed()) {
 			coins[3]->setDestroyed(true);
 			coinSoundController->characterPickedUpCoin();
 		}
 	}
 	if (glfwGetKey(window, GLFW_KEY_5) == GLFW_PRESS && keyCanRetrigger(currentFrame, key5LastTime)) {
-		if (!coins[4]->isDestroyed()) {
+		if (coins.size() > 4 && !coins[4]->isDestroyed()) {
 			coins[4]->setDestroyed(true);
 			coinSoundController->characterPickedUpCoin();
 		}
 	}
 	if (glfwGetKey(window, GLFW_KEY_6) == GLFW_PRESS && keyCanRetrigger(currentFrame, key6LastTime)) {
-		if (!coins[5]->isDestroyed()) {
+		if (coins.size() > 5 && !coins[5]->isDestroyed()) {
 			coins[5]->setDestroyed(true);
 			coinSoundController->characterPickedUpCoin();
 		}
 	}
 	if (glfwGetKey(window, GLFW_KEY_7) == GLFW_PRESS && keyCanRetrigger(currentFrame, key7LastTime)) {
-		if (!coins[6]->isDestroyed()) {
+		if (coins.size() > 6 && !coins[6]->isDestroyed()) {
 			coins[6]->setDestroyed(true);
 			coinSoundController->characterPickedUpCoin();
 		}
 	}
 	if (glfwGetKey(window, GLFW_KEY_8) == GLFW_PRESS && keyCanRetrigger(currentFrame, key8LastTime)) {
-		if (!coins[7]->isDestroyed()) {
+		if (coins.size() > 7 && !coins[7]->isDestroyed()) {
 			coins[7]->setDestroyed(true);
 			coinSoundController->characterPickedUpCoin();
 		}
 	}
 	if (glfwGetKey(window, GLFW_KEY_9) == GLFW_PRESS && keyCanRetrigger(currentFrame, key9LastTime)) {
-		if (!coins[8]->isDestroyed()) {
+		if (coins.size() > 8 && !coins[8]->isDestroyed()) {
 			coins[8]->setDestroyed(true);
 			coinSoundController->characterPickedUpCoin();
 		}
 	}
 	if (glfwGetKey(window, GLFW_KEY_0) == GLFW_PRESS && keyCanRetrigger(currentFrame, key0LastTime)) {
-		if (!coins[9]->isDestroyed()) {
+		if (coins.size() > 9 && !coins[9]->isDestroyed()) {
 			coins[9]->setDestroyed(true);
 			coinSoundController->characterPickedUpCoin();
 		}